@@ -98,7 +98,12 @@ void VoxelEngineApp::renderMainCamera(render::RenderContext& render_context, ren
 
     {
         VOXEL_ENGINE_PROFILE_GPU_SCOPE(render_world)
-        m_world_renderer->setCameraPosition(camera.getProjection().position);
+        render::CameraProjection& projection = camera.getProjection();
+        m_world_renderer->setCameraPosition(projection.position);
+        // perspective holds tangents of half view angles, ortho cameras have no view cone
+        math::Vec3f forward(projection.basis_matrix[2].x, projection.basis_matrix[2].y, projection.basis_matrix[2].z);
+        f32 half_fov_tan = math::len(projection.perspective);
+        m_world_renderer->setCameraView(half_fov_tan > 0.0f ? forward : math::Vec3f(0.0f), 2.0f * atan(half_fov_tan));
         m_world_renderer->render(render_context);
     }
 
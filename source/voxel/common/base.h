@@ -5,6 +5,7 @@
 #include <memory>
 #include <functional>
 #include <optional>
+#include <mutex>
 #include <phmap/phmap.h>
 #include "voxel/common/config.h"
 
@@ -68,6 +69,12 @@ using parallel_flat_hash_map = phmap::parallel_flat_hash_map<T...>;
 template<typename... T>
 using parallel_flat_hash_set = phmap::parallel_flat_hash_set<T...>;
 
+// parallel hashmap, split into 2^N submaps, each guarded by its own mutex
+template<typename K, typename V, std::size_t N = 4>
+using concurrent_flat_hash_map = phmap::parallel_flat_hash_map<K, V,
+        phmap::priv::hash_default_hash<K>, phmap::priv::hash_default_eq<K>,
+        phmap::priv::Allocator<phmap::priv::Pair<const K, V>>, N, std::mutex>;
+
 } // voxel
 
 #endif //VOXEL_ENGINE_BASE_H
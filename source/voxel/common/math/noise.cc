@@ -0,0 +1,218 @@
+#include "noise.h"
+
+#include <cmath>
+#include <vector>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VOXEL_ENGINE_NOISE_SSE2
+#include <emmintrin.h>
+#endif
+
+
+namespace voxel {
+namespace math {
+namespace noise {
+
+static const u32 PRIME_X = 0x9E3779B1u;
+static const u32 PRIME_Y = 0x85EBCA77u;
+static const u32 PRIME_MIX = 0x2C1B3C6Du;
+
+static inline u32 hash(u32 seed, i32 x, i32 y) {
+    u32 h = seed ^ (u32(x) * PRIME_X) ^ (u32(y) * PRIME_Y);
+    h ^= h >> 15;
+    h *= PRIME_MIX;
+    h ^= h >> 12;
+    return h;
+}
+
+static inline f32 hashToValue(u32 h) {
+    return f32(i32(h) >> 8) * (1.0f / 8388608.0f);
+}
+
+static inline f32 hashToGradient(u32 h, f32 dx, f32 dy) {
+    // one of 4 diagonal gradients
+    return ((h & 1u) ? -dx : dx) + ((h & 2u) ? -dy : dy);
+}
+
+static inline f32 fade(f32 t) {
+    return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+}
+
+static inline f32 lerp(f32 a, f32 b, f32 t) {
+    return a + t * (b - a);
+}
+
+f32 sample(NoiseType type, u32 seed, f32 x, f32 y) {
+    f32 fx = std::floor(x);
+    f32 fy = std::floor(y);
+    i32 ix = i32(fx);
+    i32 iy = i32(fy);
+    f32 dx = x - fx;
+    f32 dy = y - fy;
+    u32 h00 = hash(seed, ix, iy);
+    u32 h10 = hash(seed, ix + 1, iy);
+    u32 h01 = hash(seed, ix, iy + 1);
+    u32 h11 = hash(seed, ix + 1, iy + 1);
+
+    f32 v00, v10, v01, v11;
+    if (type == NOISE_VALUE) {
+        v00 = hashToValue(h00);
+        v10 = hashToValue(h10);
+        v01 = hashToValue(h01);
+        v11 = hashToValue(h11);
+    } else {
+        v00 = hashToGradient(h00, dx, dy);
+        v10 = hashToGradient(h10, dx - 1.0f, dy);
+        v01 = hashToGradient(h01, dx, dy - 1.0f);
+        v11 = hashToGradient(h11, dx - 1.0f, dy - 1.0f);
+    }
+    f32 tx = fade(dx);
+    f32 ty = fade(dy);
+    return lerp(lerp(v00, v10, tx), lerp(v01, v11, tx), ty);
+}
+
+
+#ifdef VOXEL_ENGINE_NOISE_SSE2
+
+// SSE2 has no 32-bit low multiplication, so it is composed from two 32x32->64 multiplications
+static inline __m128i mullo(__m128i a, __m128i b) {
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+static inline __m128i hash4(__m128i seed, __m128i x_mul, __m128i y) {
+    __m128i h = _mm_xor_si128(_mm_xor_si128(seed, x_mul), mullo(y, _mm_set1_epi32(i32(PRIME_Y))));
+    h = _mm_xor_si128(h, _mm_srli_epi32(h, 15));
+    h = mullo(h, _mm_set1_epi32(i32(PRIME_MIX)));
+    return _mm_xor_si128(h, _mm_srli_epi32(h, 12));
+}
+
+static inline __m128 hashToValue4(__m128i h) {
+    return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(h, 8)), _mm_set1_ps(1.0f / 8388608.0f));
+}
+
+static inline __m128 hashToGradient4(__m128i h, __m128 dx, __m128 dy) {
+    // negation is done by flipping the sign bit, selected by lowest hash bits
+    __m128i one = _mm_set1_epi32(1);
+    __m128 sign_x = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h, one), 31));
+    __m128 sign_y = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(h, 1), one), 31));
+    return _mm_add_ps(_mm_xor_ps(dx, sign_x), _mm_xor_ps(dy, sign_y));
+}
+
+static inline __m128 fade4(__m128 t) {
+    __m128 inner = _mm_add_ps(_mm_mul_ps(t, _mm_sub_ps(_mm_mul_ps(t, _mm_set1_ps(6.0f)), _mm_set1_ps(15.0f))), _mm_set1_ps(10.0f));
+    return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t, t), t), inner);
+}
+
+static inline __m128 lerp4(__m128 a, __m128 b, __m128 t) {
+    return _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a)));
+}
+
+static inline __m128 floor4(__m128 x) {
+    __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+    return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, x), _mm_set1_ps(1.0f)));
+}
+
+static void sampleRow4(NoiseType type, u32 seed, f32 x, f32 y, f32 step, i32 count, f32* output) {
+    // y is the same for the whole row
+    f32 fy = std::floor(y);
+    i32 iy = i32(fy);
+    __m128 dy = _mm_set1_ps(y - fy);
+    __m128 dy1 = _mm_set1_ps(y - fy - 1.0f);
+    __m128 ty = _mm_set1_ps(fade(y - fy));
+    __m128i iy0 = _mm_set1_epi32(iy);
+    __m128i iy1 = _mm_set1_epi32(iy + 1);
+    __m128i seed4 = _mm_set1_epi32(i32(seed));
+    __m128i prime_x = _mm_set1_epi32(i32(PRIME_X));
+    __m128 one = _mm_set1_ps(1.0f);
+
+    i32 i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 index = _mm_cvtepi32_ps(_mm_setr_epi32(i, i + 1, i + 2, i + 3));
+        __m128 xs = _mm_add_ps(_mm_set1_ps(x), _mm_mul_ps(index, _mm_set1_ps(step)));
+        __m128 fx = floor4(xs);
+        __m128i ix = _mm_cvttps_epi32(fx);
+        __m128 dx = _mm_sub_ps(xs, fx);
+        __m128i x0_mul = mullo(ix, prime_x);
+        __m128i x1_mul = mullo(_mm_add_epi32(ix, _mm_set1_epi32(1)), prime_x);
+
+        __m128i h00 = hash4(seed4, x0_mul, iy0);
+        __m128i h10 = hash4(seed4, x1_mul, iy0);
+        __m128i h01 = hash4(seed4, x0_mul, iy1);
+        __m128i h11 = hash4(seed4, x1_mul, iy1);
+
+        __m128 v00, v10, v01, v11;
+        if (type == NOISE_VALUE) {
+            v00 = hashToValue4(h00);
+            v10 = hashToValue4(h10);
+            v01 = hashToValue4(h01);
+            v11 = hashToValue4(h11);
+        } else {
+            __m128 dx1 = _mm_sub_ps(dx, one);
+            v00 = hashToGradient4(h00, dx, dy);
+            v10 = hashToGradient4(h10, dx1, dy);
+            v01 = hashToGradient4(h01, dx, dy1);
+            v11 = hashToGradient4(h11, dx1, dy1);
+        }
+        __m128 tx = fade4(dx);
+        _mm_storeu_ps(output + i, lerp4(lerp4(v00, v10, tx), lerp4(v01, v11, tx), ty));
+    }
+    for (; i < count; i++) {
+        output[i] = sample(type, seed, x + f32(i) * step, y);
+    }
+}
+
+bool isSimdEnabled() {
+    return true;
+}
+
+void sampleRow(NoiseType type, u32 seed, f32 x, f32 y, f32 step, i32 count, f32* output) {
+    sampleRow4(type, seed, x, y, step, count, output);
+}
+
+#else
+
+bool isSimdEnabled() {
+    return false;
+}
+
+void sampleRow(NoiseType type, u32 seed, f32 x, f32 y, f32 step, i32 count, f32* output) {
+    for (i32 i = 0; i < count; i++) {
+        output[i] = sample(type, seed, x + f32(i) * step, y);
+    }
+}
+
+#endif
+
+
+void sampleFractalRow(NoiseType type, u32 seed, const FractalSettings& settings, f32 x, f32 y, f32 step, i32 count, f32* output) {
+    std::vector<f32> octave(count);
+    for (i32 i = 0; i < count; i++) {
+        output[i] = 0;
+    }
+
+    f32 frequency = settings.frequency;
+    f32 amplitude = 1;
+    f32 total_amplitude = 0;
+    for (i32 o = 0; o < settings.octaves; o++) {
+        // each octave uses its own seed, so layers are not correlated at the origin
+        sampleRow(type, seed + u32(o) * PRIME_X, x * frequency, y * frequency, step * frequency, count, octave.data());
+        for (i32 i = 0; i < count; i++) {
+            output[i] += octave[i] * amplitude;
+        }
+        total_amplitude += amplitude;
+        frequency *= settings.lacunarity;
+        amplitude *= settings.gain;
+    }
+
+    if (total_amplitude > 0) {
+        f32 scale = 1.0f / total_amplitude;
+        for (i32 i = 0; i < count; i++) {
+            output[i] *= scale;
+        }
+    }
+}
+
+} // noise
+} // math
+} // voxel
@@ -0,0 +1,45 @@
+#ifndef VOXEL_ENGINE_NOISE_H
+#define VOXEL_ENGINE_NOISE_H
+
+#include "voxel/common/base.h"
+
+
+namespace voxel {
+namespace math {
+
+/*
+ * Deterministic 2D value and gradient noise. Row functions evaluate several samples at once with SSE2,
+ * when it is available, otherwise they fall back to the scalar implementation, both produce the same results.
+ * All noise values are roughly in [-1, 1] range.
+ */
+namespace noise {
+
+enum NoiseType {
+    NOISE_VALUE,
+    NOISE_GRADIENT
+};
+
+struct FractalSettings {
+    // amount of summed layers, each next layer has frequency multiplied by lacunarity and amplitude multiplied by gain
+    i32 octaves = 4;
+    f32 frequency = 1;
+    f32 lacunarity = 2;
+    f32 gain = 0.5f;
+};
+
+// returns true, if row functions use SIMD instructions
+bool isSimdEnabled();
+
+f32 sample(NoiseType type, u32 seed, f32 x, f32 y);
+
+// fills output with count samples at (x + i * step, y)
+void sampleRow(NoiseType type, u32 seed, f32 x, f32 y, f32 step, i32 count, f32* output);
+
+// same as sampleRow, but for the sum of octaves, normalized by total amplitude
+void sampleFractalRow(NoiseType type, u32 seed, const FractalSettings& settings, f32 x, f32 y, f32 step, i32 count, f32* output);
+
+} // noise
+} // math
+} // voxel
+
+#endif //VOXEL_ENGINE_NOISE_H
@@ -0,0 +1,124 @@
+#include "metrics.h"
+
+#include <sstream>
+#include <iomanip>
+#include "voxel/common/threading.h"
+
+
+namespace voxel {
+
+f64 MetricsRegistry::HistogramSnapshot::getMean() const {
+    return count > 0 ? total / count : 0.0;
+}
+
+void MetricsRegistry::Histogram::record(i64 nanos) {
+    nanos = std::max<i64>(nanos, 0);
+    i32 bucket = 0;
+    while (bucket < BUCKETS - 1 && (nanos >> (bucket + 1)) > 0) {
+        bucket++;
+    }
+    m_buckets[bucket]++;
+    m_count++;
+    m_total += nanos;
+
+    i64 max = m_max;
+    while (nanos > max && !m_max.compare_exchange_weak(max, nanos)) {
+    }
+}
+
+MetricsRegistry::HistogramSnapshot MetricsRegistry::Histogram::getSnapshot() const {
+    i64 buckets[BUCKETS];
+    i64 count = 0;
+    for (i32 i = 0; i < BUCKETS; i++) {
+        buckets[i] = m_buckets[i];
+        count += buckets[i];
+    }
+
+    HistogramSnapshot snapshot;
+    snapshot.count = count;
+    snapshot.total = m_total / 1000000.0;
+    snapshot.max = m_max / 1000000.0;
+    if (count == 0) {
+        return snapshot;
+    }
+
+    f64* percentiles[] = { &snapshot.p50, &snapshot.p90, &snapshot.p99 };
+    f64 ranks[] = { 0.5, 0.9, 0.99 };
+    i64 accumulated = 0;
+    i32 percentile = 0;
+    for (i32 i = 0; i < BUCKETS && percentile < 3; i++) {
+        accumulated += buckets[i];
+        while (percentile < 3 && accumulated >= ranks[percentile] * count) {
+            // bucket upper bound can not exceed max value
+            *percentiles[percentile++] = std::min(f64(u64(1) << (i + 1)) / 1000000.0, snapshot.max);
+        }
+    }
+    return snapshot;
+}
+
+std::string MetricsRegistry::Snapshot::toString() const {
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(2);
+    for (auto& counter : counters) {
+        ss << counter.first << "=" << counter.second << " ";
+    }
+    for (auto& gauge : gauges) {
+        ss << gauge.first << "=" << gauge.second << " ";
+    }
+    for (auto& histogram : histograms) {
+        auto& value = histogram.second;
+        if (value.count > 0) {
+            ss << histogram.first << "={n=" << value.count << " mean=" << value.getMean() << "ms p50=" << value.p50
+               << "ms p99=" << value.p99 << "ms max=" << value.max << "ms} ";
+        }
+    }
+    std::string result = ss.str();
+    if (!result.empty()) {
+        result.pop_back();
+    }
+    return result;
+}
+
+MetricsRegistry::Counter& MetricsRegistry::getCounter(const std::string& name) {
+    ThreadLock lock(m_mutex);
+    auto& counter = m_counters[name];
+    if (!counter) {
+        counter = CreateUnique<Counter>();
+    }
+    return *counter;
+}
+
+MetricsRegistry::Gauge& MetricsRegistry::getGauge(const std::string& name) {
+    ThreadLock lock(m_mutex);
+    auto& gauge = m_gauges[name];
+    if (!gauge) {
+        gauge = CreateUnique<Gauge>();
+    }
+    return *gauge;
+}
+
+MetricsRegistry::Histogram& MetricsRegistry::getHistogram(const std::string& name) {
+    ThreadLock lock(m_mutex);
+    auto& histogram = m_histograms[name];
+    if (!histogram) {
+        histogram = CreateUnique<Histogram>();
+    }
+    return *histogram;
+}
+
+MetricsRegistry::Snapshot MetricsRegistry::getSnapshot() {
+    ThreadLock lock(m_mutex);
+    Snapshot snapshot;
+    for (auto& counter : m_counters) {
+        snapshot.counters[counter.first] = counter.second->get();
+    }
+    for (auto& gauge : m_gauges) {
+        snapshot.gauges[gauge.first] = gauge.second->get();
+    }
+    for (auto& histogram : m_histograms) {
+        snapshot.histograms[histogram.first] = histogram.second->getSnapshot();
+    }
+    return snapshot;
+}
+
+} // voxel
@@ -0,0 +1,109 @@
+#ifndef VOXEL_ENGINE_METRICS_H
+#define VOXEL_ENGINE_METRICS_H
+
+#include <map>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include "voxel/common/base.h"
+#include "voxel/common/utils/time.h"
+
+
+namespace voxel {
+
+/*
+ * Registry of named metrics: counters, gauges and latency histograms. Metrics are created on the first request
+ * and live as long as the registry, so references to them can be stored. Updating metrics is lock-free.
+ */
+class MetricsRegistry {
+public:
+    class Counter {
+        std::atomic<i64> m_value = 0;
+
+    public:
+        inline void add(i64 value = 1) { m_value += value; }
+        inline i64 get() const { return m_value; }
+
+        inline void operator++(int) { add(); }
+        inline void operator+=(i64 value) { add(value); }
+        inline operator i64() const { return get(); }
+    };
+
+    class Gauge {
+        std::atomic<i64> m_value = 0;
+
+    public:
+        inline void set(i64 value) { m_value = value; }
+        inline void add(i64 value) { m_value += value; }
+        inline i64 get() const { return m_value; }
+    };
+
+    struct HistogramSnapshot {
+        i64 count = 0;
+        // all values are in milliseconds, percentiles are upper bounds of histogram buckets
+        f64 total = 0;
+        f64 max = 0;
+        f64 p50 = 0;
+        f64 p90 = 0;
+        f64 p99 = 0;
+
+        f64 getMean() const;
+    };
+
+    // latency histogram, bucket i contains values from 2^i to 2^(i+1) nanoseconds
+    class Histogram {
+    public:
+        static const i32 BUCKETS = 48;
+
+    private:
+        std::atomic<i64> m_buckets[BUCKETS] = {};
+        std::atomic<i64> m_count = 0;
+        std::atomic<i64> m_total = 0;
+        std::atomic<i64> m_max = 0;
+
+    public:
+        void record(i64 nanos);
+        HistogramSnapshot getSnapshot() const;
+    };
+
+    // records time from construction to destruction into the histogram
+    class ScopedTimer {
+        Histogram& m_histogram;
+        u64 m_start;
+
+    public:
+        inline explicit ScopedTimer(Histogram& histogram) : m_histogram(histogram), m_start(utils::getTimestampNanos()) {}
+        inline ~ScopedTimer() { m_histogram.record(i64(utils::getTimestampNanos() - m_start)); }
+    };
+
+    struct Snapshot {
+        std::map<std::string, i64> counters;
+        std::map<std::string, i64> gauges;
+        std::map<std::string, HistogramSnapshot> histograms;
+
+        // formats snapshot as a single line, histograms with no values are skipped
+        std::string toString() const;
+    };
+
+private:
+    std::mutex m_mutex;
+    std::unordered_map<std::string, Unique<Counter>> m_counters;
+    std::unordered_map<std::string, Unique<Gauge>> m_gauges;
+    std::unordered_map<std::string, Unique<Histogram>> m_histograms;
+
+public:
+    MetricsRegistry() = default;
+    MetricsRegistry(const MetricsRegistry&) = delete;
+    MetricsRegistry(MetricsRegistry&&) = delete;
+
+    Counter& getCounter(const std::string& name);
+    Gauge& getGauge(const std::string& name);
+    Histogram& getHistogram(const std::string& name);
+
+    Snapshot getSnapshot();
+};
+
+} // voxel
+
+#endif //VOXEL_ENGINE_METRICS_H
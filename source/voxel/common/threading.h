@@ -3,6 +3,8 @@
 
 #include "voxel/common/threading/task_executor.h"
 #include "voxel/common/threading/thread_pool.h"
+#include "voxel/common/threading/shared_worker_pool.h"
+#include "voxel/common/threading/work_stealing_pool.h"
 #include "voxel/common/threading/worker_thread.h"
 #include "voxel/common/threading/ticking_thread.h"
 
@@ -2,12 +2,14 @@
 #define VOXEL_ENGINE_BLOCKING_QUEUE_H
 
 #include <queue>
+#include <vector>
 #include <atomic>
 #include <mutex>
 #include <optional>
 #include <condition_variable>
 #include "voxel/common/base.h"
 #include "voxel/common/utils/queue.h"
+#include "voxel/common/utils/heap.h"
 
 
 namespace voxel {
@@ -119,6 +121,145 @@ public:
 };
 
 
+// blocking priority queue, where each key is present only once: pushing existing key replaces its value
+// and raises its priority in place, when MaxSize is exceeded, items with the lowest priority are evicted,
+// T must have i64 priority field
+template<typename K, typename T, std::size_t MaxSize = 0>
+class UniquePriorityQueue {
+    struct Item {
+        K key;
+        T value;
+        i32 max_heap_index = -1;
+        i32 min_heap_index = -1;
+    };
+
+    struct MaxHeapIndex {
+        inline i32& operator()(Item& item) { return item.max_heap_index; }
+    };
+    struct MaxHeapValue {
+        inline i64 operator()(Item& item) { return item.value.priority; }
+    };
+    struct MinHeapIndex {
+        inline i32& operator()(Item& item) { return item.min_heap_index; }
+    };
+    struct MinHeapValue {
+        inline i64 operator()(Item& item) { return -item.value.priority; }
+    };
+
+    flat_hash_map<K, Unique<Item>> m_items;
+    Heap<Item, MaxHeapIndex, MaxHeapValue> m_max_heap;
+    Heap<Item, MinHeapIndex, MinHeapValue> m_min_heap;
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::atomic<bool> m_released = false;
+
+public:
+    // returns true, if key was not present in the queue
+    bool push(const K& key, const T& value) {
+        std::optional<T> evicted;
+        return push(key, value, evicted);
+    }
+
+    // same as push, value of the item, evicted because MaxSize was exceeded, is moved into evicted
+    bool push(const K& key, const T& value, std::optional<T>& evicted) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto it = m_items.find(key);
+        if (it != m_items.end()) {
+            Item* item = it->second.get();
+            i64 priority = std::max(item->value.priority, value.priority);
+            item->value = value;
+            item->value.priority = priority;
+            m_max_heap.updateItem(item);
+            m_min_heap.updateItem(item);
+            return false;
+        }
+
+        Item* item = m_items.emplace(key, CreateUnique<Item>(Item { key, value })).first->second.get();
+        m_max_heap.addItem(item);
+        m_min_heap.addItem(item);
+        if constexpr(MaxSize > 0) {
+            if (m_items.size() > MaxSize) {
+                evicted = removeItem(m_min_heap.getFirst());
+            }
+        }
+        m_condition.notify_one();
+        return true;
+    }
+
+    T pop() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_condition.wait(lock, [=] { return m_max_heap.size() > 0; });
+        return removeItem(m_max_heap.getFirst());
+    }
+
+    std::optional<T> tryPop(bool block = false) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (block) {
+            m_condition.wait(lock, [=] { return m_released || m_max_heap.size() > 0; });
+            if (m_released) {
+                return std::optional<T>();
+            }
+        } else if (m_max_heap.size() == 0) {
+            return std::optional<T>();
+        }
+        return std::optional<T>(removeItem(m_max_heap.getFirst()));
+    }
+
+    bool remove(const K& key) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto it = m_items.find(key);
+        if (it != m_items.end()) {
+            removeItem(it->second.get());
+            return true;
+        }
+        return false;
+    }
+
+    void release() {
+        m_released = true;
+        m_condition.notify_all();
+    }
+
+    // returns amount of removed items, their values are appended to removed, if it is given
+    i32 clear(std::vector<T>* removed = nullptr) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        i32 count = 0;
+        for (; m_max_heap.size() > 0; count++) {
+            T value = removeItem(m_max_heap.getFirst());
+            if (removed != nullptr) {
+                removed->emplace_back(std::move(value));
+            }
+        }
+        return count;
+    }
+
+    i32 getSize() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return i32(m_items.size());
+    }
+
+    // returns priority of the item, that would be popped next, or nothing, if queue is empty
+    std::optional<i64> peekPriority() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_max_heap.size() == 0) {
+            return std::optional<i64>();
+        }
+        return std::optional<i64>(m_max_heap.getFirst()->value.priority);
+    }
+
+private:
+    T removeItem(Item* item) {
+        m_max_heap.removeItem(item);
+        m_min_heap.removeItem(item);
+        T value(std::move(item->value));
+        K key(item->key);
+        m_items.erase(key);
+        return value;
+    }
+};
+
+
 template<typename T>
 class UniqueBlockingQueue {
     Queue<T> m_queue;
@@ -138,6 +279,17 @@ public:
         }
     }
 
+    // pushes all values, that are not yet queued, under a single lock
+    void pushAll(const std::vector<T>& values) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (auto& value : values) {
+            if (m_item_set.insert(value).second) {
+                m_queue.emplace_back(value);
+            }
+        }
+        m_condition.notify_all();
+    }
+
     void shift(const T& value) {
         std::unique_lock<std::mutex> lock(m_mutex);
         if (m_item_set.find(value) == m_item_set.end()) {
@@ -0,0 +1,183 @@
+#include "shared_worker_pool.h"
+#include "voxel/common/utils/time.h"
+
+
+namespace voxel {
+namespace threading {
+
+SharedWorkerPool::SharedWorkerPool(i32 thread_count) {
+    thread_count = std::max(thread_count, 1);
+    for (i32 i = 0; i < thread_count; i++) {
+        m_threads.emplace_back(&SharedWorkerPool::run, this, i);
+    }
+}
+
+SharedWorkerPool::~SharedWorkerPool() {
+    shutdown();
+}
+
+void SharedWorkerPool::registerClient(Client* client, const std::string& name, ClientSettings settings) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    Unique<ClientState> state = CreateUnique<ClientState>();
+    state->client = client;
+    state->name = name;
+    state->settings = settings;
+    state->virtual_runtime = m_min_virtual_runtime;
+    state->idle = true;
+    m_clients.emplace_back(std::move(state));
+}
+
+void SharedWorkerPool::unregisterClient(Client* client) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    ClientState* state = findClient(client);
+    if (state == nullptr) {
+        return;
+    }
+    state->removed = true;
+    m_client_condition.wait(lock, [&] { return state->running_tasks == 0; });
+    for (auto it = m_clients.begin(); it != m_clients.end(); it++) {
+        if (it->get() == state) {
+            m_clients.erase(it);
+            break;
+        }
+    }
+}
+
+void SharedWorkerPool::notify(Client* client) {
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        ClientState* state = findClient(client);
+        if (state == nullptr || state->removed) {
+            return;
+        }
+        state->notify_counter++;
+        if (state->idle) {
+            // waking client must not get all workers to catch up with the time it was idle
+            state->idle = false;
+            state->virtual_runtime = std::max(state->virtual_runtime, m_min_virtual_runtime);
+        }
+        m_notify_counter++;
+    }
+    m_condition.notify_one();
+}
+
+void SharedWorkerPool::setClientSettings(Client* client, ClientSettings settings) {
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        ClientState* state = findClient(client);
+        if (state == nullptr) {
+            return;
+        }
+        state->settings = settings;
+        m_notify_counter++;
+    }
+    m_condition.notify_all();
+}
+
+void SharedWorkerPool::shutdown() {
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (!m_running) {
+            return;
+        }
+        m_running = false;
+    }
+    m_condition.notify_all();
+    for (auto& thread : m_threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+}
+
+i32 SharedWorkerPool::getThreadCount() const {
+    return i32(m_threads.size());
+}
+
+std::vector<SharedWorkerPool::ClientStats> SharedWorkerPool::getClientStats() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::vector<ClientStats> result;
+    for (auto& state : m_clients) {
+        ClientStats stats;
+        stats.name = state->name;
+        stats.settings = state->settings;
+        stats.running_tasks = state->running_tasks;
+        stats.executed_tasks = state->executed_tasks;
+        stats.busy_time = f64(state->busy_time) / 1000000.0;
+        stats.cpu_share = m_total_busy_time > 0 ? f32(f64(state->busy_time) / f64(m_total_busy_time)) : 0.0f;
+        result.emplace_back(stats);
+    }
+    return result;
+}
+
+SharedWorkerPool::ClientState* SharedWorkerPool::findClient(Client* client) {
+    for (auto& state : m_clients) {
+        if (state->client == client) {
+            return state.get();
+        }
+    }
+    return nullptr;
+}
+
+SharedWorkerPool::ClientState* SharedWorkerPool::pickClient() {
+    ClientState* result = nullptr;
+    for (auto& state : m_clients) {
+        if (state->idle || state->removed) {
+            continue;
+        }
+        if (state->settings.max_concurrent_tasks > 0 && state->running_tasks >= state->settings.max_concurrent_tasks) {
+            continue;
+        }
+        if (result == nullptr || state->virtual_runtime < result->virtual_runtime) {
+            result = state.get();
+        }
+    }
+    if (result != nullptr) {
+        m_min_virtual_runtime = std::max(m_min_virtual_runtime, result->virtual_runtime);
+    }
+    return result;
+}
+
+void SharedWorkerPool::run(i32 worker_index) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_running) {
+        u64 notify_counter = m_notify_counter;
+        ClientState* state = pickClient();
+        if (state == nullptr) {
+            m_condition.wait(lock, [&] { return !m_running || m_notify_counter != notify_counter; });
+            continue;
+        }
+
+        // client state is not removed, while it has running tasks, so it can be used without the lock
+        state->running_tasks++;
+        u64 client_notify_counter = state->notify_counter;
+        lock.unlock();
+        u64 start = utils::getTimestampNanos();
+        bool executed = state->client->runNextTask(worker_index);
+        u64 elapsed = utils::getTimestampNanos() - start;
+        lock.lock();
+
+        bool was_at_quota = state->settings.max_concurrent_tasks > 0 && state->running_tasks >= state->settings.max_concurrent_tasks;
+        state->running_tasks--;
+        if (executed) {
+            state->executed_tasks++;
+            state->busy_time += elapsed;
+            state->virtual_runtime += u64(f64(elapsed) / std::max(state->settings.weight, 0.001f));
+            m_total_busy_time += elapsed;
+        } else if (state->notify_counter == client_notify_counter) {
+            // client was not notified since task search began, so it has no tasks
+            state->idle = true;
+        }
+
+        if (state->removed && state->running_tasks == 0) {
+            m_client_condition.notify_all();
+        } else if (was_at_quota && !state->idle) {
+            // other workers might be waiting for this client to go below its quota
+            m_notify_counter++;
+            m_condition.notify_one();
+        }
+    }
+}
+
+} // threading
+} // voxel
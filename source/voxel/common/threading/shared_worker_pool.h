@@ -0,0 +1,112 @@
+#ifndef VOXEL_ENGINE_SHARED_WORKER_POOL_H
+#define VOXEL_ENGINE_SHARED_WORKER_POOL_H
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "voxel/common/base.h"
+
+
+namespace voxel {
+namespace threading {
+
+/*
+ * Pool of worker threads, shared between multiple clients (for example chunk sources of different worlds).
+ * Clients own their task queues, pool only decides, which client runs its next task on a free worker.
+ * Scheduling is fair: each client accumulates virtual runtime (busy time divided by its weight) and the client
+ * with the lowest virtual runtime is picked first, clients can also limit amount of concurrently running tasks.
+ * Client, that had no tasks, is skipped until it calls notify().
+ */
+class SharedWorkerPool {
+public:
+    class Client {
+    public:
+        virtual ~Client() = default;
+
+        // runs single queued task on given worker, returns false, if client has no queued tasks
+        virtual bool runNextTask(i32 worker_index) = 0;
+    };
+
+    struct ClientSettings {
+        // relative share of worker time, client gets, while other clients are busy
+        f32 weight = 1;
+
+        // max amount of tasks of this client, running at the same time, 0 means no limit
+        i32 max_concurrent_tasks = 0;
+    };
+
+    struct ClientStats {
+        std::string name;
+        ClientSettings settings;
+        i32 running_tasks = 0;
+        i64 executed_tasks = 0;
+
+        // total time in milliseconds, workers spent running tasks of this client
+        f64 busy_time = 0;
+
+        // part of total busy time of the pool, spent on this client
+        f32 cpu_share = 0;
+    };
+
+private:
+    struct ClientState {
+        Client* client;
+        std::string name;
+        ClientSettings settings;
+
+        u64 virtual_runtime = 0;
+        i32 running_tasks = 0;
+        u64 notify_counter = 0;
+        bool idle = false;
+        bool removed = false;
+
+        i64 executed_tasks = 0;
+        u64 busy_time = 0;
+    };
+
+    std::vector<std::thread> m_threads;
+    std::vector<Unique<ClientState>> m_clients;
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::condition_variable m_client_condition;
+    u64 m_notify_counter = 0;
+    u64 m_min_virtual_runtime = 0;
+    u64 m_total_busy_time = 0;
+    bool m_running = true;
+
+public:
+    SharedWorkerPool(i32 thread_count);
+    SharedWorkerPool(const SharedWorkerPool&) = delete;
+    SharedWorkerPool(SharedWorkerPool&&) = delete;
+    ~SharedWorkerPool();
+
+    // registers client, it starts receiving workers after first notify()
+    void registerClient(Client* client, const std::string& name, ClientSettings settings);
+
+    // removes client and waits for its running tasks to finish, must not be called from the task of this client
+    void unregisterClient(Client* client);
+
+    // must be called after client queued new tasks
+    void notify(Client* client);
+
+    void setClientSettings(Client* client, ClientSettings settings);
+
+    // stops all workers after their current task is finished, clients must be unregistered by their owners
+    void shutdown();
+
+    i32 getThreadCount() const;
+    std::vector<ClientStats> getClientStats();
+
+private:
+    ClientState* findClient(Client* client);
+    ClientState* pickClient();
+    void run(i32 worker_index);
+};
+
+} // threading
+} // voxel
+
+#endif //VOXEL_ENGINE_SHARED_WORKER_POOL_H
@@ -0,0 +1,247 @@
+#ifndef VOXEL_ENGINE_WORK_STEALING_POOL_H
+#define VOXEL_ENGINE_WORK_STEALING_POOL_H
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include "voxel/common/base.h"
+#include "voxel/common/threading/blocking_queue.h"
+#include "voxel/common/threading/shared_worker_pool.h"
+
+
+namespace voxel {
+namespace threading {
+
+/*
+ * Pool of worker threads, where each worker owns its own unique priority queue of tasks. Task is submitted
+ * to the worker, selected by locality hash of its key, so tasks with the same locality are usually executed
+ * by the same worker, idle workers steal from the worker, whose next task has the highest priority.
+ * Shutdown does not wait for queued tasks, it only waits for tasks, that are currently running,
+ * long running tasks can check isRunning() to stop early.
+ * If shared worker pool is given, pool does not start its own threads and runs its tasks on the shared workers,
+ * in this case there is a queue per shared worker. Tasks, that are evicted from full queues or cancelled, are
+ * passed to the optional dropped task consumer, so their owner can release state, that awaits them.
+ */
+template<typename K, typename T, std::size_t MaxSizePerWorker = 0>
+class WorkStealingPool : public SharedWorkerPool::Client {
+public:
+    using Consumer = std::function<void(const T&)>;
+    using Locality = std::function<u64(const K&)>;
+
+private:
+    struct Worker {
+        UniquePriorityQueue<K, T, MaxSizePerWorker> queue;
+        std::thread thread;
+    };
+
+    Consumer m_consumer;
+    Locality m_locality;
+    Consumer m_dropped_consumer;
+    std::vector<Unique<Worker>> m_workers;
+    Shared<SharedWorkerPool> m_shared_pool;
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::atomic<u64> m_submit_counter = 0;
+    std::atomic<bool> m_running = true;
+
+    std::atomic<i64> m_executed_tasks = 0;
+    std::atomic<i64> m_stolen_tasks = 0;
+
+public:
+    // thread count is ignored, if shared pool is given
+    WorkStealingPool(
+            Consumer consumer,
+            Locality locality,
+            i32 thread_count,
+            Shared<SharedWorkerPool> shared_pool = nullptr,
+            const std::string& name = "",
+            SharedWorkerPool::ClientSettings settings = {}) :
+            m_consumer(consumer), m_locality(locality), m_shared_pool(std::move(shared_pool)) {
+        thread_count = m_shared_pool ? m_shared_pool->getThreadCount() : std::max(thread_count, 1);
+        for (i32 i = 0; i < thread_count; i++) {
+            m_workers.emplace_back(CreateUnique<Worker>());
+        }
+        if (m_shared_pool) {
+            m_shared_pool->registerClient(this, name, settings);
+            return;
+        }
+        for (i32 i = 0; i < thread_count; i++) {
+            m_workers[i]->thread = std::thread(&WorkStealingPool::run, this, i);
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool(WorkStealingPool&&) = delete;
+
+    ~WorkStealingPool() override {
+        shutdown();
+    }
+
+    // must be set before the first submit, it is called outside of queue locks and is not called on shutdown
+    void setDroppedTaskConsumer(Consumer consumer) {
+        m_dropped_consumer = consumer;
+    }
+
+    // queues task to the worker, selected by key locality, if task with this key is already queued, it is replaced
+    void submit(const K& key, const T& task) {
+        if (!m_running) {
+            return;
+        }
+        std::optional<T> evicted;
+        m_workers[getWorkerIndex(key)]->queue.push(key, task, evicted);
+        if (evicted.has_value() && m_dropped_consumer) {
+            m_dropped_consumer(evicted.value());
+        }
+        if (m_shared_pool) {
+            m_shared_pool->notify(this);
+            return;
+        }
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_submit_counter++;
+        }
+        m_condition.notify_one();
+    }
+
+    // removes queued task, returns true, if it was queued
+    bool cancel(const K& key) {
+        return m_workers[getWorkerIndex(key)]->queue.remove(key);
+    }
+
+    // removes all queued tasks, running tasks are not interrupted, returns amount of removed tasks
+    i32 cancelAll() {
+        i32 count = 0;
+        std::vector<T> removed;
+        bool notify_dropped = m_dropped_consumer && m_running;
+        for (auto& worker : m_workers) {
+            count += worker->queue.clear(notify_dropped ? &removed : nullptr);
+        }
+        for (auto& task : removed) {
+            m_dropped_consumer(task);
+        }
+        return count;
+    }
+
+    // stops accepting tasks, drops all queued tasks and joins workers, after their current task is finished
+    void shutdown() {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (!m_running) {
+                return;
+            }
+            m_running = false;
+        }
+        m_condition.notify_all();
+        cancelAll();
+        if (m_shared_pool) {
+            m_shared_pool->unregisterClient(this);
+        }
+        for (auto& worker : m_workers) {
+            if (worker->thread.joinable()) {
+                worker->thread.join();
+            }
+        }
+    }
+
+    bool isRunning() const {
+        return m_running;
+    }
+
+    i32 getThreadCount() const {
+        return i32(m_workers.size());
+    }
+
+    i32 getQueuedTaskCount() {
+        i32 count = 0;
+        for (auto& worker : m_workers) {
+            count += worker->queue.getSize();
+        }
+        return count;
+    }
+
+    i64 getExecutedTaskCount() const {
+        return m_executed_tasks;
+    }
+
+    i64 getStolenTaskCount() const {
+        return m_stolen_tasks;
+    }
+
+    const Shared<SharedWorkerPool>& getSharedPool() const {
+        return m_shared_pool;
+    }
+
+    // called by the shared worker pool
+    bool runNextTask(i32 worker_index) override {
+        if (!m_running) {
+            return false;
+        }
+        std::optional<T> task = tryTakeTask(worker_index % i32(m_workers.size()));
+        if (!task.has_value()) {
+            return false;
+        }
+        m_consumer(task.value());
+        m_executed_tasks++;
+        return true;
+    }
+
+private:
+    i32 getWorkerIndex(const K& key) {
+        return i32(m_locality(key) % m_workers.size());
+    }
+
+    std::optional<T> tryTakeTask(i32 worker_index) {
+        // own queue goes first, then steal from the worker, whose next task has the highest priority
+        std::optional<T> task = m_workers[worker_index]->queue.tryPop();
+        if (task.has_value()) {
+            return task;
+        }
+        i32 worker_count = i32(m_workers.size());
+        // victim queue can be drained between peek and pop, then all queues are checked again
+        for (i32 attempt = 0; attempt < worker_count; attempt++) {
+            i32 victim = -1;
+            i64 victim_priority = 0;
+            for (i32 i = 1; i < worker_count; i++) {
+                i32 index = (worker_index + i) % worker_count;
+                std::optional<i64> priority = m_workers[index]->queue.peekPriority();
+                if (priority.has_value() && (victim < 0 || priority.value() > victim_priority)) {
+                    victim = index;
+                    victim_priority = priority.value();
+                }
+            }
+            if (victim < 0) {
+                break;
+            }
+            task = m_workers[victim]->queue.tryPop();
+            if (task.has_value()) {
+                m_stolen_tasks++;
+                return task;
+            }
+        }
+        return task;
+    }
+
+    void run(i32 worker_index) {
+        while (m_running) {
+            // remember submit counter before looking for tasks, so submit during the search is not missed
+            u64 submit_counter = m_submit_counter;
+            std::optional<T> task = tryTakeTask(worker_index);
+            if (task.has_value()) {
+                m_consumer(task.value());
+                m_executed_tasks++;
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [&] { return !m_running || m_submit_counter != submit_counter; });
+        }
+    }
+};
+
+} // threading
+} // voxel
+
+#endif //VOXEL_ENGINE_WORK_STEALING_POOL_H
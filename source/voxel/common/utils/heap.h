@@ -97,7 +97,7 @@ public:
 
             i32 max_index;
             ItemRef max_item;
-            if (!left_item || right_item && m_item_value(*left_item) < m_item_value(*right_item)) {
+            if (!left_item || (right_item && m_item_value(*left_item) < m_item_value(*right_item))) {
                 max_index = right_index;
                 max_item = right_item;
             } else {
@@ -0,0 +1,147 @@
+#ifndef VOXEL_ENGINE_TIMER_WHEEL_H
+#define VOXEL_ENGINE_TIMER_WHEEL_H
+
+#include <vector>
+#include "voxel/common/base.h"
+#include "voxel/common/utils/queue.h"
+
+
+namespace voxel {
+
+/*
+ * Hierarchical timer wheel, where each item is scheduled at most once: scheduling existing item replaces its time.
+ * Each level has 64 slots, level 0 slot covers a single tick of given resolution, every next level slot covers
+ * the whole previous level. Items are moved to lower levels, when their slot is reached, so both scheduling
+ * and expiration are O(1). Replaced and cancelled items are skipped lazily. Not thread-safe.
+ */
+template<typename T, i32 Levels = 4>
+class TimerWheel {
+    static const i32 SLOT_BITS = 6;
+    static const i32 SLOTS = 1 << SLOT_BITS;
+    static const u64 EXPIRED = ~u64(0);
+
+    struct Entry {
+        T item;
+        u64 tick;
+    };
+
+    u64 m_resolution;
+    u64 m_current_tick;
+    std::vector<Entry> m_slots[Levels][SLOTS];
+    i64 m_slot_entries = 0;
+
+    // current tick of each scheduled item or EXPIRED, if it is expired and is not yet polled
+    flat_hash_map<T, u64> m_item_ticks;
+    Queue<T> m_expired;
+
+public:
+    TimerWheel(u64 resolution, u64 time) : m_resolution(std::max<u64>(resolution, 1)), m_current_tick(time / m_resolution) {
+    }
+
+    // schedules item to expire at given time or replaces its time, if it is already scheduled
+    void schedule(const T& item, u64 time) {
+        u64 tick = (time + m_resolution - 1) / m_resolution;
+        auto it = m_item_ticks.find(item);
+        if (it != m_item_ticks.end()) {
+            if (it->second == tick) {
+                return;
+            }
+            it->second = tick;
+        } else {
+            m_item_ticks.emplace(item, tick);
+        }
+        insert({ item, tick });
+    }
+
+    bool cancel(const T& item) {
+        return m_item_ticks.erase(item) > 0;
+    }
+
+    bool isScheduled(const T& item) {
+        return m_item_ticks.find(item) != m_item_ticks.end();
+    }
+
+    // moves all items, that are due at given time, to the expired queue
+    void advance(u64 time) {
+        u64 target_tick = time / m_resolution;
+        while (m_current_tick < target_tick) {
+            if (m_slot_entries == 0) {
+                m_current_tick = target_tick;
+                break;
+            }
+            m_current_tick++;
+
+            // when lower level completes its round, next slot of the higher level is moved down
+            for (i32 level = 1; level < Levels; level++) {
+                if ((m_current_tick & ((u64(1) << (SLOT_BITS * level)) - 1)) != 0) {
+                    break;
+                }
+                std::vector<Entry> entries = std::move(m_slots[level][(m_current_tick >> (SLOT_BITS * level)) & (SLOTS - 1)]);
+                m_slot_entries -= i64(entries.size());
+                for (auto& entry : entries) {
+                    if (isEntryValid(entry)) {
+                        insert(entry);
+                    }
+                }
+            }
+
+            std::vector<Entry> entries = std::move(m_slots[0][m_current_tick & (SLOTS - 1)]);
+            m_slot_entries -= i64(entries.size());
+            for (auto& entry : entries) {
+                if (isEntryValid(entry)) {
+                    expire(entry.item);
+                }
+            }
+        }
+    }
+
+    // returns next expired item, that was not rescheduled or cancelled since expiration
+    std::optional<T> pollExpired() {
+        while (!m_expired.empty()) {
+            T item(std::move(m_expired.pop_front()));
+            auto it = m_item_ticks.find(item);
+            if (it != m_item_ticks.end() && it->second == EXPIRED) {
+                m_item_ticks.erase(it);
+                return std::optional<T>(std::move(item));
+            }
+        }
+        return std::optional<T>();
+    }
+
+    // amount of scheduled and expired, but not yet polled items
+    i32 getSize() {
+        return i32(m_item_ticks.size());
+    }
+
+private:
+    bool isEntryValid(const Entry& entry) {
+        auto it = m_item_ticks.find(entry.item);
+        return it != m_item_ticks.end() && it->second == entry.tick;
+    }
+
+    void expire(const T& item) {
+        m_item_ticks[item] = EXPIRED;
+        m_expired.emplace_back(item);
+    }
+
+    void insert(const Entry& entry) {
+        if (entry.tick <= m_current_tick) {
+            expire(entry.item);
+            return;
+        }
+
+        // items, that are too far in the future, are put to the last slot of the highest level and moved down later
+        u64 delta = std::min(entry.tick - m_current_tick, (u64(1) << (SLOT_BITS * Levels)) - 1);
+        u64 slot_tick = m_current_tick + delta;
+        i32 level = 0;
+        while (level < Levels - 1 && delta >= (u64(1) << (SLOT_BITS * (level + 1)))) {
+            level++;
+        }
+        m_slots[level][(slot_tick >> (SLOT_BITS * level)) & (SLOTS - 1)].emplace_back(entry);
+        m_slot_entries++;
+    }
+};
+
+} // voxel
+
+#endif //VOXEL_ENGINE_TIMER_WHEEL_H
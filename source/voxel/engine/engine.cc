@@ -50,6 +50,17 @@ namespace voxel {
         return m_logger;
     }
 
+    Shared<threading::SharedWorkerPool> Engine::getChunkWorkerPool(i32 thread_count) {
+        ThreadLock lock(m_chunk_worker_pool_mutex);
+        if (!m_chunk_worker_pool) {
+            if (thread_count <= 0) {
+                thread_count = i32(std::thread::hardware_concurrency());
+            }
+            m_chunk_worker_pool = CreateShared<threading::SharedWorkerPool>(thread_count);
+        }
+        return m_chunk_worker_pool;
+    }
+
     Context& Engine::newContext(const std::string& context_name) {
         return *m_contexts.emplace_back(CreateUnique<Context>(*this, context_name));
     }
@@ -41,6 +41,10 @@ class Engine : public std::enable_shared_from_this<Engine> {
     // thread for initializing glfw contexts and other glfw-related work
     threading::WorkerThread m_glfw_thread;
 
+    // worker pool, shared between chunk sources of all worlds, created on first request
+    std::mutex m_chunk_worker_pool_mutex;
+    Shared<threading::SharedWorkerPool> m_chunk_worker_pool;
+
 public:
     Engine();
     Engine(const Engine& other) = delete;
@@ -57,6 +61,9 @@ public:
     // getters
     Logger& getLogger();
 
+    // returns engine-wide worker pool for chunk sources, thread count is used only on first call, 0 means hardware concurrency
+    Shared<threading::SharedWorkerPool> getChunkWorkerPool(i32 thread_count = 0);
+
     // creates and initializes new context from this engine
     Context& newContext(const std::string& context_name);
 
@@ -61,6 +61,13 @@ RiffStyleFileFormat::RiffChunk RiffStyleFileFormat::_readRiffChunkRecursive(std:
 }
 
 std::vector<VoxelModel> RiffStyleFileFormat::read(std::istream& istream) {
+    RiffStyleFileFormat::RiffFile riff_file = readRiffFile(istream);
+
+    // pass to riff reader
+    return readRiff(riff_file);
+}
+
+RiffStyleFileFormat::RiffFile RiffStyleFileFormat::readRiffFile(std::istream& istream) {
     RiffStyleFileFormat::RiffFile riff_file;
 
     // read type
@@ -81,9 +88,7 @@ std::vector<VoxelModel> RiffStyleFileFormat::read(std::istream& istream) {
         }
         riff_file.chunks.emplace_back(std::move(_readRiffChunkRecursive(istream)));
     }
-
-    // pass to riff reader
-    return readRiff(riff_file);
+    return riff_file;
 }
 
 std::vector<VoxelModel> RiffStyleFileFormat::readRiff(RiffFile& riff_file) {
@@ -39,6 +39,9 @@ public:
     std::vector<VoxelModel> read(std::istream& istream) override;
     virtual std::vector<VoxelModel> readRiff(RiffFile& riff_file);
 
+    // reads file type, version and all root chunks
+    RiffFile readRiffFile(std::istream& istream);
+
 private:
     RiffChunk _readRiffChunkRecursive(std::istream& istream, i32 depth = 0);
 };
@@ -1,4 +1,9 @@
 #include <iostream>
+#include <sstream>
+#include <cstring>
+#include <cstdlib>
+#include <unordered_map>
+#include <unordered_set>
 #include "vox_file_format.h"
 
 
@@ -34,18 +39,21 @@ struct RawVoxelModel {
 };
 
 
-std::vector<VoxelModel> VoxFileFormat::readRiff(RiffFile& riff_file) {
+static RiffStyleFileFormat::RiffChunk* getMainChunk(RiffStyleFileFormat::RiffFile& riff_file) {
     if (riff_file.chunks.empty() || riff_file.type != std::string("VOX ") || riff_file.version != 150) {
         std::cerr << "invalid VOX file\n";
-        return {};
+        return nullptr;
     }
 
-    RiffChunk main_chunk = riff_file.chunks[0];
+    RiffStyleFileFormat::RiffChunk& main_chunk = riff_file.chunks[0];
     if (main_chunk.id != std::string("MAIN")) {
         std::cerr << "VOX: no MAIN chunk\n";
-        return {};
+        return nullptr;
     }
+    return &main_chunk;
+}
 
+static std::vector<VoxelModel> readModels(RiffStyleFileFormat::RiffChunk& main_chunk) {
     VoxelPalette palette = {
             0x00000000, 0xffffffff, 0xffccffff, 0xff99ffff, 0xff66ffff, 0xff33ffff, 0xff00ffff, 0xffffccff, 0xffccccff, 0xff99ccff, 0xff66ccff, 0xff33ccff, 0xff00ccff, 0xffff99ff, 0xffcc99ff, 0xff9999ff,
             0xff6699ff, 0xff3399ff, 0xff0099ff, 0xffff66ff, 0xffcc66ff, 0xff9966ff, 0xff6666ff, 0xff3366ff, 0xff0066ff, 0xffff33ff, 0xffcc33ff, 0xff9933ff, 0xff6633ff, 0xff3333ff, 0xff0033ff, 0xffff00ff,
@@ -94,6 +102,250 @@ std::vector<VoxelModel> VoxFileFormat::readRiff(RiffFile& riff_file) {
     return result;
 }
 
+std::vector<VoxelModel> VoxFileFormat::readRiff(RiffFile& riff_file) {
+    RiffChunk* main_chunk = getMainChunk(riff_file);
+    if (main_chunk == nullptr) {
+        return {};
+    }
+    return readModels(*main_chunk);
+}
+
+// reads values of scene graph chunks, all reads past the end of chunk return zero values and invalidate reader
+class VoxChunkReader {
+    const std::vector<byte>& m_bytes;
+    size_t m_offset = 0;
+    bool m_valid = true;
+
+public:
+    explicit VoxChunkReader(const std::vector<byte>& bytes) : m_bytes(bytes) {
+    }
+
+    bool isValid() const {
+        return m_valid;
+    }
+
+    i32 readInt() {
+        if (m_offset + sizeof(i32) > m_bytes.size()) {
+            m_valid = false;
+            return 0;
+        }
+        i32 value;
+        std::memcpy(&value, &m_bytes[m_offset], sizeof(i32));
+        m_offset += sizeof(i32);
+        return value;
+    }
+
+    std::string readString() {
+        i32 length = readInt();
+        if (length < 0 || m_offset + length > m_bytes.size()) {
+            m_valid = false;
+            return "";
+        }
+        std::string value(reinterpret_cast<const char*>(m_bytes.data()) + m_offset, length);
+        m_offset += length;
+        return value;
+    }
+
+    std::unordered_map<std::string, std::string> readDict() {
+        std::unordered_map<std::string, std::string> dict;
+        i32 count = readInt();
+        for (i32 i = 0; i < count && m_valid; i++) {
+            std::string key = readString();
+            dict[key] = readString();
+        }
+        return dict;
+    }
+};
+
+struct VoxSceneNode {
+    enum Type {
+        NODE_TRANSFORM,
+        NODE_GROUP,
+        NODE_SHAPE
+    };
+
+    Type type;
+    std::string name;
+    bool hidden = false;
+
+    // transform node, rotation and translation are already in engine coordinates
+    i32 child = -1;
+    i32 layer = -1;
+    VoxelRotation rotation = VoxelRotation::identity();
+    math::Vec3i translation;
+
+    // group node
+    std::vector<i32> children;
+
+    // shape node, only the first model is used, others are animation frames
+    i32 model = -1;
+};
+
+// MagicaVoxel packs rotation into a byte: indices of non-zero elements in first two rows and signs of all rows
+static VoxelRotation decodeVoxRotation(u8 packed) {
+    i32 index0 = packed & 3;
+    i32 index1 = (packed >> 2) & 3;
+    if (index0 > 2 || index1 > 2 || index0 == index1) {
+        return VoxelRotation::identity();
+    }
+    i32 indices[3] = { index0, index1, 3 - index0 - index1 };
+
+    VoxelRotation vox_rotation = {{ { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 } }};
+    for (i32 row = 0; row < 3; row++) {
+        vox_rotation.matrix[row][indices[row]] = (packed >> (4 + row)) & 1 ? -1 : 1;
+    }
+
+    // VOX is z-up, engine is y-up, so y and z are swapped in both rows and columns
+    static const i32 axis[3] = { 0, 2, 1 };
+    VoxelRotation rotation;
+    for (i32 i = 0; i < 3; i++) {
+        for (i32 j = 0; j < 3; j++) {
+            rotation.matrix[i][j] = vox_rotation.matrix[axis[i]][axis[j]];
+        }
+    }
+    return rotation;
+}
+
+static bool readSceneNodes(RiffStyleFileFormat::RiffChunk& main_chunk, std::unordered_map<i32, VoxSceneNode>& nodes, std::unordered_set<i32>& hidden_layers) {
+    for (auto& chunk : main_chunk.children) {
+        VoxChunkReader reader(chunk.bytes);
+        if (chunk.id == std::string("LAYR")) {
+            i32 layer_id = reader.readInt();
+            auto attributes = reader.readDict();
+            if (attributes["_hidden"] == "1") {
+                hidden_layers.emplace(layer_id);
+            }
+            continue;
+        }
+
+        VoxSceneNode node;
+        if (chunk.id == std::string("nTRN")) {
+            node.type = VoxSceneNode::NODE_TRANSFORM;
+        } else if (chunk.id == std::string("nGRP")) {
+            node.type = VoxSceneNode::NODE_GROUP;
+        } else if (chunk.id == std::string("nSHP")) {
+            node.type = VoxSceneNode::NODE_SHAPE;
+        } else {
+            continue;
+        }
+
+        i32 node_id = reader.readInt();
+        auto attributes = reader.readDict();
+        node.name = attributes["_name"];
+        node.hidden = attributes["_hidden"] == "1";
+
+        if (node.type == VoxSceneNode::NODE_TRANSFORM) {
+            node.child = reader.readInt();
+            reader.readInt(); // reserved
+            node.layer = reader.readInt();
+            i32 frame_count = reader.readInt();
+            for (i32 i = 0; i < frame_count && reader.isValid(); i++) {
+                auto frame = reader.readDict();
+                if (i > 0) {
+                    continue;
+                }
+                if (!frame["_r"].empty()) {
+                    node.rotation = decodeVoxRotation(u8(std::atoi(frame["_r"].c_str())));
+                }
+                if (!frame["_t"].empty()) {
+                    i32 x = 0, y = 0, z = 0;
+                    std::istringstream(frame["_t"]) >> x >> y >> z;
+                    node.translation = math::Vec3i(x, z, y);
+                }
+            }
+        } else if (node.type == VoxSceneNode::NODE_GROUP) {
+            i32 child_count = reader.readInt();
+            for (i32 i = 0; i < child_count && reader.isValid(); i++) {
+                node.children.emplace_back(reader.readInt());
+            }
+        } else {
+            i32 model_count = reader.readInt();
+            for (i32 i = 0; i < model_count && reader.isValid(); i++) {
+                i32 model_id = reader.readInt();
+                reader.readDict();
+                if (i == 0) {
+                    node.model = model_id;
+                }
+            }
+        }
+
+        if (!reader.isValid()) {
+            std::cerr << "VOX: invalid scene node " << chunk.id << "\n";
+            return false;
+        }
+        nodes[node_id] = std::move(node);
+    }
+    return true;
+}
+
+static void flattenSceneNode(
+        VoxScene& scene,
+        const std::unordered_map<i32, VoxSceneNode>& nodes,
+        const std::unordered_set<i32>& hidden_layers,
+        i32 node_id, const VoxelRotation& rotation, const math::Vec3i& translation, const std::string& name, i32 depth) {
+    auto it = nodes.find(node_id);
+    // depth limit protects from cycles in broken files
+    if (it == nodes.end() || depth > 256) {
+        return;
+    }
+    const VoxSceneNode& node = it->second;
+    if (node.hidden) {
+        return;
+    }
+
+    if (node.type == VoxSceneNode::NODE_TRANSFORM) {
+        if (hidden_layers.count(node.layer)) {
+            return;
+        }
+        // world = parent_rotation * (rotation * v + translation) + parent_translation
+        flattenSceneNode(scene, nodes, hidden_layers, node.child,
+                rotation * node.rotation, rotation.apply(node.translation) + translation,
+                node.name.empty() ? name : node.name, depth + 1);
+    } else if (node.type == VoxSceneNode::NODE_GROUP) {
+        for (i32 child : node.children) {
+            flattenSceneNode(scene, nodes, hidden_layers, child, rotation, translation, name, depth + 1);
+        }
+    } else if (node.model >= 0 && node.model < i32(scene.models.size())) {
+        // translation moves the model center, instance position is the min corner of the rotated model
+        math::Vec3i size = scene.models[node.model]->getSize();
+        math::Vec3i pivot(size.x / 2, size.y / 2, size.z / 2);
+        math::Vec3i min(0x7fffffff);
+        for (i32 corner = 0; corner < 8; corner++) {
+            math::Vec3i v(corner & 1 ? size.x - 1 : 0, corner & 2 ? size.y - 1 : 0, corner & 4 ? size.z - 1 : 0);
+            math::Vec3i r = rotation.apply(v - pivot);
+            min = math::Vec3i(std::min(min.x, r.x), std::min(min.y, r.y), std::min(min.z, r.z));
+        }
+        scene.instances.push_back({ node.model, min + translation, rotation, name });
+    }
+}
+
+VoxScene VoxFileFormat::readScene(std::istream& istream) {
+    RiffFile riff_file = readRiffFile(istream);
+    return readSceneRiff(riff_file);
+}
+
+VoxScene VoxFileFormat::readSceneRiff(RiffFile& riff_file) {
+    VoxScene scene;
+    RiffChunk* main_chunk = getMainChunk(riff_file);
+    if (main_chunk == nullptr) {
+        return scene;
+    }
+    for (auto& model : readModels(*main_chunk)) {
+        scene.models.emplace_back(CreateShared<VoxelModel>(std::move(model)));
+    }
+
+    std::unordered_map<i32, VoxSceneNode> nodes;
+    std::unordered_set<i32> hidden_layers;
+    if (readSceneNodes(*main_chunk, nodes, hidden_layers) && !nodes.empty()) {
+        // node 0 is the root transform
+        flattenSceneNode(scene, nodes, hidden_layers, 0, VoxelRotation::identity(), math::Vec3i(0), "", 0);
+    } else {
+        for (i32 i = 0; i < i32(scene.models.size()); i++) {
+            scene.instances.push_back({ i, math::Vec3i(0), VoxelRotation::identity(), "" });
+        }
+    }
+    return scene;
+}
 
 } // format
 } // voxel
\ No newline at end of file
@@ -1,14 +1,42 @@
 #ifndef VOXEL_ENGINE_VOX_FILE_FORMAT_H
 #define VOXEL_ENGINE_VOX_FILE_FORMAT_H
 
+#include <string>
+#include "voxel/common/math/vec.h"
+#include "voxel/engine/shared/voxel_rotation.h"
 #include "voxel/engine/file/riff_file_format.h"
 
 namespace voxel {
 namespace format {
 
+/*
+ * Flattened MagicaVoxel scene: each model is loaded once and referenced by all its instances.
+ * Instance transforms are converted to engine coordinates (y is up), hidden nodes and layers are skipped.
+ */
+struct VoxScene {
+    struct Instance {
+        // index in models
+        i32 model_index;
+
+        // position of the min corner of rotated model in scene voxels
+        math::Vec3i position;
+        VoxelRotation rotation;
+
+        // name of the closest named transform node
+        std::string name;
+    };
+
+    std::vector<Shared<VoxelModel>> models;
+    std::vector<Instance> instances;
+};
+
 class VoxFileFormat : public RiffStyleFileFormat {
 public:
     std::vector<VoxelModel> readRiff(RiffFile& riff_file) override;
+
+    // reads models and scene graph, files without scene graph get single instance of each model at the origin
+    VoxScene readScene(std::istream& istream);
+    VoxScene readSceneRiff(RiffFile& riff_file);
 };
 
 } // format
@@ -99,7 +99,8 @@ void ChunkBuffer::runUploadQueue(ChunkSource& chunk_source) {
             UploadRequest request = popped.value();
             chunk_source.accessChunk<chunk_access_policy_weak>(request.chunk_ref, [&](Chunk& chunk) {
                 i32 buffer_size = chunk.getBufferSize();
-                if (buffer_size <= request.allocated_page_count * m_page_size) {
+                // buffers of lazy chunks can be compressed, such chunks are not rendered anyway
+                if (buffer_size <= request.allocated_page_count * m_page_size && chunk.getBuffer() != nullptr) {
                     m_data_shader_buffer.setDataSpan(request.offset_page * m_page_size * sizeof(u32), buffer_size * sizeof(u32), chunk.getBuffer());
                 }
             }, [&] (bool exists) {
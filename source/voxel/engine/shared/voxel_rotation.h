@@ -0,0 +1,60 @@
+#ifndef VOXEL_ENGINE_VOXEL_ROTATION_H
+#define VOXEL_ENGINE_VOXEL_ROTATION_H
+
+#include "voxel/common/base.h"
+#include "voxel/common/math/vec.h"
+
+
+namespace voxel {
+
+// axis aligned rotation or reflection of voxel grid, matrix rows contain a single non-zero element of 1 or -1
+struct VoxelRotation {
+    i8 matrix[3][3];
+
+    inline static constexpr VoxelRotation identity() {
+        return {{ { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } }};
+    }
+
+    // counter-clockwise rotation around y axis by given amount of quarter turns
+    inline static VoxelRotation aroundY(i32 quarter_turns) {
+        switch (quarter_turns & 3) {
+            case 1: return {{ { 0, 0, 1 }, { 0, 1, 0 }, { -1, 0, 0 } }};
+            case 2: return {{ { -1, 0, 0 }, { 0, 1, 0 }, { 0, 0, -1 } }};
+            case 3: return {{ { 0, 0, -1 }, { 0, 1, 0 }, { 1, 0, 0 } }};
+            default: return identity();
+        }
+    }
+
+    inline math::Vec3i apply(const math::Vec3i& v) const {
+        return math::Vec3i(
+                matrix[0][0] * v.x + matrix[0][1] * v.y + matrix[0][2] * v.z,
+                matrix[1][0] * v.x + matrix[1][1] * v.y + matrix[1][2] * v.z,
+                matrix[2][0] * v.x + matrix[2][1] * v.y + matrix[2][2] * v.z);
+    }
+
+    // for orthogonal matrix inverse is the transpose
+    inline VoxelRotation inverse() const {
+        VoxelRotation result;
+        for (i32 i = 0; i < 3; i++) {
+            for (i32 j = 0; j < 3; j++) {
+                result.matrix[i][j] = matrix[j][i];
+            }
+        }
+        return result;
+    }
+
+    // returns rotation, that applies other first and this second
+    inline VoxelRotation operator*(const VoxelRotation& other) const {
+        VoxelRotation result;
+        for (i32 i = 0; i < 3; i++) {
+            for (i32 j = 0; j < 3; j++) {
+                result.matrix[i][j] = i8(matrix[i][0] * other.matrix[0][j] + matrix[i][1] * other.matrix[1][j] + matrix[i][2] * other.matrix[2][j]);
+            }
+        }
+        return result;
+    }
+};
+
+} // voxel
+
+#endif //VOXEL_ENGINE_VOXEL_ROTATION_H
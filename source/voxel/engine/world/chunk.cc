@@ -5,11 +5,21 @@
 
 #include "chunk.h"
 #include "voxel/common/utils/time.h"
+#include "voxel/engine/world/chunk_codec.h"
 
 
 namespace voxel {
 
 Chunk::Chunk(ChunkPosition position) : m_position(position) {
+    _initEmptyBuffer();
+    m_last_fetched = utils::getTimestampMillis();
+}
+
+Chunk::~Chunk() {
+    free(m_buffer);
+}
+
+void Chunk::_initEmptyBuffer() {
     // initialize buffer size
     m_buffer_voxel_span = HEADER_SIZE + 512 * TREE_NODE_SIZE;
     m_buffer_size = m_buffer_voxel_span + 4096 * VOXEL_SIZE;
@@ -24,17 +34,18 @@ Chunk::Chunk(ChunkPosition position) : m_position(position) {
     m_buffer[1] = 0u;          // reserved
     m_buffer[2] = 3u;          // empty child at idx 0 - link to chunk root
     m_buffer[3] = 0x80000000u; // empty chunk root
+}
 
-    //
-    m_last_fetched = utils::getTimestampMillis();
+const ChunkPosition& Chunk::getPosition() const {
+    return m_position;
 }
 
-Chunk::~Chunk() {
-    delete(m_buffer);
+const ChunkHandle& Chunk::getHandle() const {
+    return m_handle;
 }
 
-const ChunkPosition& Chunk::getPosition() const {
-    return m_position;
+void Chunk::setHandle(const ChunkHandle& handle) {
+    m_handle = handle;
 }
 
 const u32* Chunk::getBuffer() const {
@@ -45,6 +56,22 @@ const i32 Chunk::getBufferSize() const {
     return m_buffer_size;
 }
 
+i64 Chunk::getAllocatedMemory() const {
+    if (isBufferCompressed()) {
+        return i64(m_compressed_buffer.capacity());
+    }
+    return m_buffer != nullptr ? i64(m_buffer_size) * sizeof(u32) : 0;
+}
+
+i64 Chunk::updateAccountedMemory() {
+    i64 memory = getAllocatedMemory();
+    return memory - m_accounted_memory.exchange(memory);
+}
+
+i64 Chunk::getAccountedMemory() const {
+    return m_accounted_memory;
+}
+
 ChunkState Chunk::getState() const {
     return m_state;
 }
@@ -125,8 +152,106 @@ void Chunk::preallocate(i32 voxels) {
 }
 
 void Chunk::deleteAllBuffers() {
-    delete(m_buffer);
+    free(m_buffer);
     m_buffer = nullptr;
+    std::vector<byte>().swap(m_compressed_buffer);
+}
+
+void Chunk::compressBuffer() {
+    if (m_buffer == nullptr || isBufferCompressed()) {
+        return;
+    }
+
+    // only header with tree nodes span and allocated voxels span are meaningful, everything else is free space
+    std::vector<byte> compressed;
+    ChunkBufferCodec::encodeSpan(m_buffer, m_buffer_tree_offset, TREE_NODE_SIZE, compressed);
+    ChunkBufferCodec::encodeSpan(m_buffer + m_buffer_voxel_span, m_buffer_voxels_offset - m_buffer_voxel_span, VOXEL_SIZE, compressed);
+    compressed.shrink_to_fit();
+
+    m_compressed_buffer = std::move(compressed);
+    free(m_buffer);
+    m_buffer = nullptr;
+}
+
+bool Chunk::decompressBuffer() {
+    if (!isBufferCompressed()) {
+        return true;
+    }
+
+    m_buffer = static_cast<u32*>(calloc(m_buffer_size, sizeof(u32)));
+    if (m_buffer == nullptr) {
+        throw std::bad_alloc();
+    }
+
+    const byte* input = m_compressed_buffer.data();
+    const byte* end = input + m_compressed_buffer.size();
+    input = ChunkBufferCodec::decodeSpan(input, end, m_buffer, m_buffer_tree_offset, TREE_NODE_SIZE);
+    if (input != nullptr) {
+        input = ChunkBufferCodec::decodeSpan(input, end, m_buffer + m_buffer_voxel_span, m_buffer_voxels_offset - m_buffer_voxel_span, VOXEL_SIZE);
+    }
+
+    std::vector<byte>().swap(m_compressed_buffer);
+    if (input != end) {
+        // contents are lost, chunk is left empty, so it can be built again
+        free(m_buffer);
+        _initEmptyBuffer();
+        return false;
+    }
+    return true;
+}
+
+bool Chunk::isBufferCompressed() const {
+    return !m_compressed_buffer.empty();
+}
+
+void Chunk::writeBuffer(std::vector<byte>& output) const {
+    VOXEL_ENGINE_ASSERT(m_buffer != nullptr || isBufferCompressed());
+
+    // layout is required to restore relative child pointers, free space of the buffer is not written
+    i32 layout[4] = { m_buffer_size, m_buffer_tree_offset, m_buffer_voxel_span, m_buffer_voxels_offset };
+    output.insert(output.end(), reinterpret_cast<const byte*>(layout), reinterpret_cast<const byte*>(layout) + sizeof(layout));
+    if (isBufferCompressed()) {
+        output.insert(output.end(), m_compressed_buffer.begin(), m_compressed_buffer.end());
+    } else {
+        ChunkBufferCodec::encodeSpan(m_buffer, m_buffer_tree_offset, TREE_NODE_SIZE, output);
+        ChunkBufferCodec::encodeSpan(m_buffer + m_buffer_voxel_span, m_buffer_voxels_offset - m_buffer_voxel_span, VOXEL_SIZE, output);
+    }
+}
+
+bool Chunk::readBuffer(const byte* data, i32 size) {
+    i32 layout[4];
+    if (size < i32(sizeof(layout))) {
+        return false;
+    }
+    memcpy(layout, data, sizeof(layout));
+    i32 buffer_size = layout[0], tree_offset = layout[1], voxel_span = layout[2], voxels_offset = layout[3];
+    if (tree_offset < HEADER_SIZE + TREE_NODE_SIZE || tree_offset > voxel_span || voxel_span > voxels_offset ||
+            voxels_offset > buffer_size || (tree_offset - HEADER_SIZE) % TREE_NODE_SIZE != 0 || (voxels_offset - voxel_span) % VOXEL_SIZE != 0) {
+        return false;
+    }
+
+    u32* buffer = static_cast<u32*>(calloc(buffer_size, sizeof(u32)));
+    if (buffer == nullptr) {
+        throw std::bad_alloc();
+    }
+    const byte* input = data + sizeof(layout);
+    const byte* end = data + size;
+    input = ChunkBufferCodec::decodeSpan(input, end, buffer, tree_offset, TREE_NODE_SIZE);
+    if (input != nullptr) {
+        input = ChunkBufferCodec::decodeSpan(input, end, buffer + voxel_span, voxels_offset - voxel_span, VOXEL_SIZE);
+    }
+    if (input != end) {
+        free(buffer);
+        return false;
+    }
+
+    deleteAllBuffers();
+    m_buffer = buffer;
+    m_buffer_size = buffer_size;
+    m_buffer_tree_offset = tree_offset;
+    m_buffer_voxel_span = voxel_span;
+    m_buffer_voxels_offset = voxels_offset;
+    return true;
 }
 
 u32 Chunk::_getAllocatedNodeSpanSize() {
@@ -169,6 +294,7 @@ u32 Chunk::_allocateNewVoxel(u32 color, u32 material) {
 }
 
 void Chunk::setVoxel(VoxelPosition position, Voxel voxel) {
+    VOXEL_ENGINE_ASSERT(m_buffer != nullptr);
     u32 tree_ptr = 3;
 
     // in case of scale = 0, override chunk root as voxel
@@ -228,6 +354,27 @@ void Chunk::setVoxel(VoxelPosition position, Voxel voxel) {
     }
 }
 
+Voxel Chunk::getVoxel(VoxelPosition position) const {
+    VOXEL_ENGINE_ASSERT(m_buffer != nullptr);
+    u32 tree_ptr = 3;
+
+    // descend, while current node is a tree node
+    for (i32 i = position.scale - 1; i >= 0 && (m_buffer[tree_ptr] & 0x80000000u); i--) {
+        u8 idx = ((((position.x >> i) & 1) << 0) | (((position.y >> i) & 1) << 1) | (((position.z >> i) & 1) << 2)) ^ 7;
+        u32 child = m_buffer[tree_ptr + 2 + idx];
+        if (child == 0) {
+            return Voxel();
+        }
+        tree_ptr += child;
+    }
+
+    u32 node = m_buffer[tree_ptr];
+    if ((node & 0x80000000u) || !(node & 0x40000000u)) {
+        return Voxel();
+    }
+    return Voxel { node & 0x3FFFFFFFu, m_buffer[tree_ptr + 1] };
+}
+
 
 std::mutex& Chunk::getLock() {
     return m_lock;
@@ -241,6 +388,18 @@ void Chunk::unlock() {
     m_lock.unlock();
 }
 
+void Chunk::pin() {
+    m_pin_count++;
+}
+
+void Chunk::unpin() {
+    m_pin_count--;
+}
+
+bool Chunk::isPinned() const {
+    return m_pin_count > 0;
+}
+
 } // voxel
 
 
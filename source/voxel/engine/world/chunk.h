@@ -3,6 +3,7 @@
 
 #include <mutex>
 #include <atomic>
+#include <vector>
 
 #include "voxel/common/base.h"
 #include "voxel/engine/shared/voxel.h"
@@ -38,6 +39,21 @@ enum ChunkState {
     CHUNK_FINALIZED
 };
 
+// index of chunk slot in chunk source and generation of the slot, handle of removed chunk never resolves again
+struct ChunkHandle {
+    u32 index;
+    u32 generation;
+
+    inline constexpr ChunkHandle() : index(0xFFFFFFFFu), generation(0) {};
+    inline constexpr ChunkHandle(u32 index, u32 generation) : index(index), generation(generation) {};
+
+    inline constexpr bool operator==(const ChunkHandle& other) const { return index == other.index && generation == other.generation; }
+    inline constexpr bool operator!=(const ChunkHandle& other) const { return !this->operator==(other); }
+    inline constexpr bool valid() const { return index != 0xFFFFFFFFu; }
+
+    inline static constexpr ChunkHandle invalid() { return ChunkHandle(); }
+};
+
 class Chunk {
 private:
     static const i8 HEADER_SIZE = 3;
@@ -46,9 +62,13 @@ private:
 
 private:
     ChunkPosition m_position;
+    ChunkHandle m_handle;
     std::atomic<ChunkState> m_state = CHUNK_PENDING;
     std::mutex m_lock;
     std::atomic<u64> m_last_fetched;
+    std::atomic<i32> m_pin_count = 0;
+    // allocated memory at the moment of the last updateAccountedMemory call
+    std::atomic<i64> m_accounted_memory = 0;
 
     u32* m_buffer = nullptr;
     i32 m_buffer_tree_offset = 0;
@@ -56,6 +76,9 @@ private:
     i32 m_buffer_voxel_span = 0;
     i32 m_buffer_size = 0;
 
+    // when chunk buffer is compressed, m_buffer is released and its used spans are stored here
+    std::vector<byte> m_compressed_buffer;
+
 public:
     Chunk(ChunkPosition position);
     Chunk(const Chunk&) = delete;
@@ -63,9 +86,19 @@ public:
     ~Chunk();
 
     const ChunkPosition& getPosition() const;
+    // handle is assigned by chunk source before chunk is added to it
+    const ChunkHandle& getHandle() const;
+    void setHandle(const ChunkHandle& handle);
     const u32* getBuffer() const;
     const i32 getBufferSize() const;
 
+    // returns amount of memory in bytes, currently allocated for chunk buffer, either compressed or not
+    i64 getAllocatedMemory() const;
+    // remembers current allocated memory and returns its change since the previous call, used to track total memory of chunks
+    i64 updateAccountedMemory();
+    // returns allocated memory, remembered by the last updateAccountedMemory call, can be called without locking the chunk
+    i64 getAccountedMemory() const;
+
     ChunkState getState() const;
     void setState(ChunkState state);
     u64 getLastFetched() const;
@@ -76,7 +109,13 @@ public:
     bool tryLock();
     void unlock();
 
+    // pinned chunk is never removed from chunk source, pin and unpin must be called while chunk is still reachable
+    void pin();
+    void unpin();
+    bool isPinned() const;
+
 private:
+    void _initEmptyBuffer();
     u32 _getAllocatedNodeSpanSize();
     u32 _getAllocatedVoxelSpanSize();
     u32 _allocateNewNode(u32 color, u32 material);
@@ -85,17 +124,33 @@ private:
 public:
 
     void setVoxel(VoxelPosition position, Voxel voxel);
+    // returns voxel at given position or empty voxel, if there is none, voxel of larger scale covers all its children
+    Voxel getVoxel(VoxelPosition position) const;
     void preallocate(i32 tree_nodes, i32 voxels);
     void preallocate(i32 voxels);
     void deleteAllBuffers();
+
+    // compresses used spans of the buffer and releases it, chunk cannot be modified or uploaded until decompressed
+    void compressBuffer();
+    // restores buffer from its compressed form, returns false and leaves empty buffer, if compressed data is malformed
+    bool decompressBuffer();
+    bool isBufferCompressed() const;
+
+    // appends buffer layout and compressed used spans of the buffer to output, buffer may be compressed or not
+    void writeBuffer(std::vector<byte>& output) const;
+    // replaces buffer with one, written by writeBuffer, returns false and keeps current buffer, if data is malformed
+    bool readBuffer(const byte* data, i32 size);
 };
 
+// reference to the chunk at position, reference, created from the chunk, also keeps its handle, so it is resolved without
+// looking up the position, until this chunk is removed, references are compared and hashed by position only
 struct ChunkRef {
     inline constexpr ChunkRef() : m_pos(ChunkPosition::invalid()) {};
-    inline ChunkRef(const Chunk& chunk) : m_pos(chunk.getPosition()) {};
+    inline ChunkRef(const Chunk& chunk) : m_pos(chunk.getPosition()), m_handle(chunk.getHandle()) {};
     inline constexpr ChunkRef(const ChunkPosition& pos) : m_pos(pos) {};
 
     inline constexpr const ChunkPosition& position() const { return m_pos; }
+    inline constexpr const ChunkHandle& handle() const { return m_handle; }
     inline constexpr bool operator==(const ChunkRef& other) const { return m_pos == other.m_pos; }
     inline constexpr bool operator!=(const ChunkRef& other) const { return m_pos != other.m_pos; }
     inline constexpr bool valid() const { return m_pos != ChunkPosition::invalid(); }
@@ -103,6 +158,7 @@ struct ChunkRef {
     inline static constexpr ChunkRef invalid() { return ChunkRef(ChunkPosition::invalid()); }
 private:
     ChunkPosition m_pos;
+    ChunkHandle m_handle;
 };
 
 } // voxel
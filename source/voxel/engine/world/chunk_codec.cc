@@ -0,0 +1,75 @@
+#include "chunk_codec.h"
+
+
+namespace voxel {
+
+static inline void writeVarint(std::vector<byte>& output, u64 value) {
+    while (value >= 0x80u) {
+        output.push_back(byte(value | 0x80u));
+        value >>= 7;
+    }
+    output.push_back(byte(value));
+}
+
+static inline const byte* readVarint(const byte* input, const byte* end, u64& value) {
+    value = 0;
+    for (i32 shift = 0; input != end && shift < 64; shift += 7) {
+        byte b = *(input++);
+        value |= u64(b & 0x7Fu) << shift;
+        if (!(b & 0x80u)) {
+            return input;
+        }
+    }
+    return nullptr;
+}
+
+void ChunkBufferCodec::encodeSpan(const u32* words, i32 count, i32 stride, std::vector<byte>& output) {
+    // token format: (run length << 1) | 1 for run of exact predictions, (zigzag residual << 1) otherwise
+    u64 zero_run = 0;
+    for (i32 i = 0; i < count; i++) {
+        u32 predicted = i >= stride ? words[i - stride] : 0u;
+        i32 residual = i32(words[i] - predicted);
+        if (residual == 0) {
+            zero_run++;
+            continue;
+        }
+        if (zero_run > 0) {
+            writeVarint(output, (zero_run << 1) | 1u);
+            zero_run = 0;
+        }
+        u32 zigzag = (u32(residual) << 1) ^ u32(residual >> 31);
+        writeVarint(output, u64(zigzag) << 1);
+    }
+    if (zero_run > 0) {
+        writeVarint(output, (zero_run << 1) | 1u);
+    }
+}
+
+const byte* ChunkBufferCodec::decodeSpan(const byte* input, const byte* end, u32* words, i32 count, i32 stride) {
+    i32 i = 0;
+    while (i < count) {
+        u64 token;
+        input = readVarint(input, end, token);
+        if (input == nullptr) {
+            return nullptr;
+        }
+
+        if (token & 1u) {
+            u64 zero_run = token >> 1;
+            if (zero_run > u64(count - i)) {
+                return nullptr;
+            }
+            for (u64 j = 0; j < zero_run; j++, i++) {
+                words[i] = i >= stride ? words[i - stride] : 0u;
+            }
+        } else {
+            u32 zigzag = u32(token >> 1);
+            u32 residual = (zigzag >> 1) ^ (~(zigzag & 1u) + 1u);
+            words[i] = (i >= stride ? words[i - stride] : 0u) + residual;
+            i++;
+        }
+    }
+    return input;
+}
+
+} // voxel
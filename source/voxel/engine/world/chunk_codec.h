@@ -0,0 +1,28 @@
+#ifndef VOXEL_ENGINE_CHUNK_CODEC_H
+#define VOXEL_ENGINE_CHUNK_CODEC_H
+
+#include <vector>
+#include "voxel/common/base.h"
+
+
+namespace voxel {
+
+/*
+ * Fast lossless codec for chunk buffer spans. Chunk buffer consists of fixed size records (tree nodes or voxels),
+ * where same fields of neighbouring records are usually close to each other: colors and materials are repeated
+ * and child pointers are relative offsets, that grow with a steady pace. So each word is predicted as the same
+ * field of the previous record, zigzag encoded residual is written as varint and runs of exact predictions
+ * are collapsed into a single token.
+ */
+class ChunkBufferCodec {
+public:
+    // encodes count words with given record stride and appends result to output
+    static void encodeSpan(const u32* words, i32 count, i32 stride, std::vector<byte>& output);
+
+    // decodes count words with given record stride, returns pointer to the first unread byte or nullptr, if input is malformed
+    static const byte* decodeSpan(const byte* input, const byte* end, u32* words, i32 count, i32 stride);
+};
+
+} // voxel
+
+#endif //VOXEL_ENGINE_CHUNK_CODEC_H
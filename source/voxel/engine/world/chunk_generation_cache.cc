@@ -0,0 +1,190 @@
+#include "chunk_generation_cache.h"
+
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <filesystem>
+#include "voxel/common/utils/time.h"
+#include "voxel/engine/world/chunk.h"
+
+
+namespace voxel {
+
+static const u32 CACHE_FILE_MAGIC = 0x43475856u; // VXGC
+static const u32 CACHE_FILE_FORMAT = 1;
+
+struct CacheFileHeader {
+    u32 magic;
+    u32 format;
+    u32 provider_version;
+    u32 provider_id_size;
+    u64 seed;
+    i32 x, y, z;
+    u32 payload_size;
+    u64 payload_checksum;
+};
+
+// FNV-1a
+static u64 hashBytes(const void* data, size_t size, u64 hash = 14695981039346656037ull) {
+    const byte* bytes = static_cast<const byte*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+static void fillHeader(CacheFileHeader& header, const ChunkProvider::GenerationIdentity& identity, ChunkPosition position) {
+    memset(&header, 0, sizeof(header));
+    header.magic = CACHE_FILE_MAGIC;
+    header.format = CACHE_FILE_FORMAT;
+    header.provider_version = identity.provider_version;
+    header.provider_id_size = u32(identity.provider_id.size());
+    header.seed = identity.seed;
+    header.x = position.x;
+    header.y = position.y;
+    header.z = position.z;
+}
+
+ChunkGenerationCache::ChunkGenerationCache(Settings settings) :
+        m_settings(std::move(settings)),
+        m_files_read(m_metrics.getCounter("files_read")),
+        m_files_written(m_metrics.getCounter("files_written")),
+        m_bytes_read(m_metrics.getCounter("bytes_read")),
+        m_bytes_written(m_metrics.getCounter("bytes_written")),
+        m_dropped_writes(m_metrics.getCounter("writes_dropped")),
+        m_invalid_files(m_metrics.getCounter("invalid_files")),
+        m_write_errors(m_metrics.getCounter("write_errors")),
+        m_file_read(m_metrics.getHistogram("file_read")),
+        m_file_write(m_metrics.getHistogram("file_write")) {
+    std::error_code error;
+    std::filesystem::create_directories(m_settings.directory, error);
+}
+
+ChunkGenerationCache::~ChunkGenerationCache() {
+    flush();
+}
+
+std::string ChunkGenerationCache::getChunkFilePath(const ChunkProvider::GenerationIdentity& identity, ChunkPosition position) {
+    CacheFileHeader header;
+    fillHeader(header, identity, position);
+    u64 hash = hashBytes(&header, sizeof(header));
+    hash = hashBytes(identity.provider_id.data(), identity.provider_id.size(), hash);
+
+    // files are spread over 256 subdirectories to keep directories small
+    char name[32];
+    snprintf(name, sizeof(name), "%02x/%016llx.chunk", u32(hash >> 56), (unsigned long long) hash);
+    return m_settings.directory + "/" + name;
+}
+
+bool ChunkGenerationCache::tryLoadChunk(const ChunkProvider::GenerationIdentity& identity, Chunk& chunk) {
+    MetricsRegistry::ScopedTimer timer(m_file_read);
+    std::ifstream istream(getChunkFilePath(identity, chunk.getPosition()), std::ifstream::binary);
+    if (!istream.is_open()) {
+        return false;
+    }
+
+    CacheFileHeader expected, header;
+    fillHeader(expected, identity, chunk.getPosition());
+    std::string provider_id(identity.provider_id.size(), '\0');
+    if (!istream.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+            !istream.read(provider_id.data(), std::streamsize(provider_id.size()))) {
+        m_invalid_files++;
+        return false;
+    }
+
+    // different key with the same hash is a miss, as well as a corrupted file
+    u32 payload_size = header.payload_size;
+    u64 payload_checksum = header.payload_checksum;
+    header.payload_size = 0;
+    header.payload_checksum = 0;
+    if (memcmp(&header, &expected, sizeof(header)) != 0 || provider_id != identity.provider_id) {
+        return false;
+    }
+
+    std::vector<byte> payload(payload_size);
+    if (!istream.read(reinterpret_cast<char*>(payload.data()), std::streamsize(payload_size)) ||
+            hashBytes(payload.data(), payload.size()) != payload_checksum ||
+            !chunk.readBuffer(payload.data(), i32(payload.size()))) {
+        m_invalid_files++;
+        return false;
+    }
+
+    m_files_read++;
+    m_bytes_read += i64(sizeof(header) + provider_id.size() + payload_size);
+    return true;
+}
+
+bool ChunkGenerationCache::storeChunk(const ChunkProvider::GenerationIdentity& identity, const Chunk& chunk) {
+    {
+        std::unique_lock<std::mutex> lock(m_pending_writes_mutex);
+        if (m_pending_writes >= m_settings.max_pending_writes) {
+            m_dropped_writes++;
+            return false;
+        }
+        m_pending_writes++;
+    }
+
+    // chunk can change after this call, so file is fully prepared on the calling thread
+    CacheFileHeader header;
+    fillHeader(header, identity, chunk.getPosition());
+    std::vector<byte> data(sizeof(header) + identity.provider_id.size());
+    chunk.writeBuffer(data);
+    const byte* payload = data.data() + sizeof(header) + identity.provider_id.size();
+    header.payload_size = u32(data.data() + data.size() - payload);
+    header.payload_checksum = hashBytes(payload, header.payload_size);
+    memcpy(data.data(), &header, sizeof(header));
+    memcpy(data.data() + sizeof(header), identity.provider_id.data(), identity.provider_id.size());
+
+    std::string path = getChunkFilePath(identity, chunk.getPosition());
+    m_writer_thread.queue([this, path, data = std::move(data)] () -> void {
+        writeFile(path, data);
+        std::unique_lock<std::mutex> lock(m_pending_writes_mutex);
+        m_pending_writes--;
+        m_pending_writes_cv.notify_all();
+    });
+    return true;
+}
+
+void ChunkGenerationCache::writeFile(const std::string& path, const std::vector<byte>& data) {
+    MetricsRegistry::ScopedTimer timer(m_file_write);
+    std::error_code error;
+    std::filesystem::path file_path(path);
+    std::filesystem::create_directories(file_path.parent_path(), error);
+
+    // several processes can share the cache, so temporary file name must be unique and rename must be atomic
+    std::filesystem::path temp_path = file_path;
+    temp_path += ".tmp" + std::to_string(utils::getTimestampNanos());
+    {
+        std::ofstream ostream(temp_path, std::ofstream::binary | std::ofstream::trunc);
+        if (!ostream.write(reinterpret_cast<const char*>(data.data()), std::streamsize(data.size()))) {
+            m_write_errors++;
+            ostream.close();
+            std::filesystem::remove(temp_path, error);
+            return;
+        }
+    }
+    std::filesystem::rename(temp_path, file_path, error);
+    if (error) {
+        m_write_errors++;
+        std::filesystem::remove(temp_path, error);
+        return;
+    }
+    m_files_written++;
+    m_bytes_written += i64(data.size());
+}
+
+void ChunkGenerationCache::flush() {
+    std::unique_lock<std::mutex> lock(m_pending_writes_mutex);
+    m_pending_writes_cv.wait(lock, [this] () -> bool { return m_pending_writes == 0; });
+}
+
+i32 ChunkGenerationCache::getPendingWriteCount() {
+    std::unique_lock<std::mutex> lock(m_pending_writes_mutex);
+    return m_pending_writes;
+}
+
+MetricsRegistry& ChunkGenerationCache::getMetrics() {
+    return m_metrics;
+}
+
+} // voxel
@@ -0,0 +1,81 @@
+#ifndef VOXEL_ENGINE_CHUNK_GENERATION_CACHE_H
+#define VOXEL_ENGINE_CHUNK_GENERATION_CACHE_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include "voxel/common/base.h"
+#include "voxel/common/metrics.h"
+#include "voxel/common/threading/worker_thread.h"
+#include "voxel/engine/shared/chunk_position.h"
+#include "voxel/engine/world/chunk_provider.h"
+
+
+namespace voxel {
+
+class Chunk;
+
+/*
+ * Persistent cache of generated chunks in a directory. Each chunk is a separate file, addressed by the hash of
+ * provider identity and chunk position, so the same directory can be shared by any amount of providers, seeds and
+ * processes, and changing provider version or settings simply stops hitting old files. Full key is stored in the
+ * file and verified on load, so hash collisions and corrupted files are misses. Files are written on a background
+ * thread into temporary files and renamed, so readers never see partially written chunks.
+ */
+class ChunkGenerationCache {
+public:
+    struct Settings {
+        // root directory of the cache, created if missing
+        std::string directory;
+
+        // stores are dropped, while this amount of files is waiting to be written
+        i32 max_pending_writes = 4096;
+    };
+
+private:
+    Settings m_settings;
+    MetricsRegistry m_metrics;
+    MetricsRegistry::Counter& m_files_read;
+    MetricsRegistry::Counter& m_files_written;
+    MetricsRegistry::Counter& m_bytes_read;
+    MetricsRegistry::Counter& m_bytes_written;
+    MetricsRegistry::Counter& m_dropped_writes;
+    MetricsRegistry::Counter& m_invalid_files;
+    MetricsRegistry::Counter& m_write_errors;
+    MetricsRegistry::Histogram& m_file_read;
+    MetricsRegistry::Histogram& m_file_write;
+
+    std::mutex m_pending_writes_mutex;
+    std::condition_variable m_pending_writes_cv;
+    i32 m_pending_writes = 0;
+    // declared last to be destroyed first
+    threading::WorkerThread m_writer_thread;
+
+public:
+    ChunkGenerationCache(Settings settings);
+    ChunkGenerationCache(const ChunkGenerationCache&) = delete;
+    ChunkGenerationCache(ChunkGenerationCache&&) = delete;
+    // waits for all pending writes
+    ~ChunkGenerationCache();
+
+    // loads cached chunk buffer into the chunk, returns false, if there is no valid cached chunk
+    bool tryLoadChunk(const ChunkProvider::GenerationIdentity& identity, Chunk& chunk);
+
+    // serializes chunk buffer and queues it to be written, returns false, if store was dropped
+    bool storeChunk(const ChunkProvider::GenerationIdentity& identity, const Chunk& chunk);
+
+    // blocks until all queued writes are completed
+    void flush();
+
+    i32 getPendingWriteCount();
+    MetricsRegistry& getMetrics();
+
+private:
+    std::string getChunkFilePath(const ChunkProvider::GenerationIdentity& identity, ChunkPosition position);
+    void writeFile(const std::string& path, const std::vector<byte>& data);
+};
+
+} // voxel
+
+#endif //VOXEL_ENGINE_CHUNK_GENERATION_CACHE_H
@@ -24,20 +24,23 @@ bool ChunkLock::tryLock() {
     m_owned_chunks.clear();
     m_owned_chunks.reserve(m_chunks.size());
 
-    for (i32 i = 0; i < m_chunks.size(); i++) {
-        auto& chunk_ref = m_chunks[i];
-        chunk_source.accessChunk<chunk_access_policy_map_only>(chunk_ref, [&](Chunk& chunk) {
-            if (chunk.tryLock()) {
-                m_owned_chunks.emplace_back(std::addressof(chunk));
-            } else {
-                for (Chunk* owned : m_owned_chunks) {
-                    owned->unlock();
-                }
-                m_owned_chunks.clear();
-            };
-        });
+    // all chunks are resolved in one batch and locked in the same order for the same set of chunks
+    bool locked = true;
+    chunk_source.accessChunks<chunk_access_policy_map_only>(m_chunks, [&](Chunk& chunk, i32 index) {
+        if (locked && chunk.tryLock()) {
+            m_owned_chunks.emplace_back(std::addressof(chunk));
+        } else {
+            locked = false;
+        }
+    }, [&] (bool exists, i32 index) {
+        locked = false;
+    });
+
+    // some chunk is missing or locked by someone else, release everything, that is already locked
+    if (!locked) {
+        unlock();
+        return false;
     }
-
     return true;
 }
 
@@ -49,6 +52,7 @@ void ChunkLock::unlock() {
     for (auto& chunk : m_owned_chunks) {
         chunk->unlock();
     }
+    m_owned_chunks.clear();
 }
 
 } // voxel
\ No newline at end of file
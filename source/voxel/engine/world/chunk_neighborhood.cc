@@ -0,0 +1,35 @@
+#include "chunk_neighborhood.h"
+
+
+namespace voxel {
+
+ChunkNeighborhood::ChunkNeighborhood() {
+    for (auto& chunk : m_chunks) {
+        chunk = nullptr;
+    }
+}
+
+i32 ChunkNeighborhood::getIndex(i32 dx, i32 dy, i32 dz) {
+    return (dx + 1) + (dy + 1) * 3 + (dz + 1) * 9;
+}
+
+const Chunk& ChunkNeighborhood::getCenter() const {
+    return *m_chunks[getIndex(0, 0, 0)];
+}
+
+const Chunk* ChunkNeighborhood::getChunk(i32 dx, i32 dy, i32 dz) const {
+    VOXEL_ENGINE_ASSERT(dx >= -1 && dx <= 1 && dy >= -1 && dy <= 1 && dz >= -1 && dz <= 1);
+    return m_chunks[getIndex(dx, dy, dz)];
+}
+
+Voxel ChunkNeighborhood::getVoxel(u8 scale, i32 x, i32 y, i32 z) const {
+    // chunk offset is found by arithmetic shift, so it is rounded down for negative coordinates
+    const Chunk* chunk = getChunk(x >> scale, y >> scale, z >> scale);
+    if (chunk == nullptr) {
+        return Voxel();
+    }
+    u32 mask = (1u << scale) - 1u;
+    return chunk->getVoxel({ scale, u32(x) & mask, u32(y) & mask, u32(z) & mask });
+}
+
+} // voxel
@@ -0,0 +1,44 @@
+#ifndef VOXEL_ENGINE_CHUNK_NEIGHBORHOOD_H
+#define VOXEL_ENGINE_CHUNK_NEIGHBORHOOD_H
+
+#include "voxel/common/base.h"
+#include "voxel/engine/shared/voxel.h"
+#include "voxel/engine/world/chunk.h"
+
+
+namespace voxel {
+
+class ChunkSource;
+
+/*
+ * Read-only view of the chunk and its 26 neighbours, passed to chunk processing. All chunks in the view
+ * are locked by chunk source during processing and are at least built. Neighbour is missing only if it
+ * cannot be fetched from the chunk provider.
+ */
+class ChunkNeighborhood {
+public:
+    static const i32 SIZE = 27;
+
+private:
+    const Chunk* m_chunks[SIZE];
+
+public:
+    ChunkNeighborhood();
+
+    // dx, dy and dz are in range [-1, 1]
+    static i32 getIndex(i32 dx, i32 dy, i32 dz);
+
+    const Chunk& getCenter() const;
+    // returns nullptr, if neighbour is missing
+    const Chunk* getChunk(i32 dx, i32 dy, i32 dz) const;
+
+    // voxel position is relative to the center chunk and can be outside of it by at most one chunk,
+    // returns empty voxel, if chunk is missing
+    Voxel getVoxel(u8 scale, i32 x, i32 y, i32 z) const;
+
+    friend ChunkSource;
+};
+
+} // voxel
+
+#endif //VOXEL_ENGINE_CHUNK_NEIGHBORHOOD_H
@@ -0,0 +1,98 @@
+#include "chunk_pending_edits.h"
+
+#include "voxel/common/utils/time.h"
+#include "voxel/engine/world/chunk.h"
+
+
+namespace voxel {
+
+void ChunkPendingEdits::add(ChunkPosition position, const Edit* edits, i32 count) {
+    if (count <= 0) {
+        return;
+    }
+    u64 now = utils::getTimestampMillis();
+    m_edits.lazy_emplace_l(position, [&] (auto& entry) {
+        entry.second.edits.insert(entry.second.edits.end(), edits, edits + count);
+        entry.second.last_added = now;
+    }, [&] (const auto& ctor) {
+        ctor(position, ChunkEdits { std::vector<Edit>(edits, edits + count), now });
+    });
+    m_edit_count += count;
+}
+
+bool ChunkPendingEdits::take(ChunkPosition position, std::vector<Edit>& output) {
+    i64 taken_count = -1;
+    m_edits.erase_if(position, [&] (auto& entry) -> bool {
+        std::vector<Edit>& edits = entry.second.edits;
+        taken_count = i64(edits.size());
+        if (output.empty()) {
+            output.swap(edits);
+        } else {
+            output.insert(output.end(), edits.begin(), edits.end());
+        }
+        return true;
+    });
+    if (taken_count < 0) {
+        return false;
+    }
+    m_edit_count -= taken_count;
+    return true;
+}
+
+bool ChunkPendingEdits::contains(ChunkPosition position) const {
+    return m_edits.contains(position);
+}
+
+void ChunkPendingEdits::getPositions(std::vector<ChunkPosition>& output) const {
+    m_edits.for_each([&] (const auto& entry) {
+        output.emplace_back(entry.first);
+    });
+}
+
+void ChunkPendingEdits::clear() {
+    m_edits.clear();
+    m_edit_count = 0;
+}
+
+i64 ChunkPendingEdits::removeExpired(u64 max_age, const std::function<bool(ChunkPosition)>& keep) {
+    u64 now = utils::getTimestampMillis();
+    std::vector<ChunkPosition> expired;
+    m_edits.for_each([&] (const auto& entry) {
+        if (entry.second.last_added + max_age <= now) {
+            expired.emplace_back(entry.first);
+        }
+    });
+
+    i64 removed_count = 0;
+    for (auto& position : expired) {
+        if (keep(position)) {
+            continue;
+        }
+        // edits could be added again, since the chunk was found
+        m_edits.erase_if(position, [&] (auto& entry) -> bool {
+            if (entry.second.last_added + max_age > now) {
+                return false;
+            }
+            removed_count += i64(entry.second.edits.size());
+            return true;
+        });
+    }
+    m_edit_count -= removed_count;
+    return removed_count;
+}
+
+i64 ChunkPendingEdits::getEditCount() const {
+    return m_edit_count;
+}
+
+i64 ChunkPendingEdits::getChunkCount() const {
+    return i64(m_edits.size());
+}
+
+void ChunkPendingEdits::apply(Chunk& chunk, const std::vector<Edit>& edits) {
+    for (const Edit& edit : edits) {
+        chunk.setVoxel(edit.getPosition(), edit.voxel);
+    }
+}
+
+} // voxel
@@ -0,0 +1,92 @@
+#ifndef VOXEL_ENGINE_CHUNK_PENDING_EDITS_H
+#define VOXEL_ENGINE_CHUNK_PENDING_EDITS_H
+
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include "voxel/common/base.h"
+#include "voxel/common/config.h"
+#include "voxel/engine/shared/voxel.h"
+#include "voxel/engine/shared/chunk_position.h"
+#include "voxel/engine/shared/voxel_position.h"
+
+
+namespace voxel {
+
+class Chunk;
+
+/*
+ * Buffer of voxel edits for chunks, that are not built or cannot be modified right now. Providers emit edits for
+ * neighbor chunks, when they place structures crossing chunk borders, without locking or even creating these
+ * chunks, and each chunk applies all its edits at once, when it is built or loaded next time. Edits of each chunk
+ * are kept in a single vector in one of the lock-sharded submaps, so concurrent builds rarely contend. Edits of
+ * chunks, that are never created, are removed after a timeout by the owner.
+ */
+class ChunkPendingEdits {
+public:
+    // voxel, that replaces voxel at position inside target chunk, position is packed into 32 bits
+    struct Edit {
+        static const i32 COORD_BITS = 9;
+        static const u32 COORD_MASK = (1u << COORD_BITS) - 1;
+
+        u32 position;
+        Voxel voxel;
+
+        // each coordinate must be less, than 2^scale, and fit into COORD_BITS
+        static inline bool isValidPosition(VoxelPosition position) {
+            return position.scale <= COORD_BITS && ((position.x | position.y | position.z) >> position.scale) == 0;
+        }
+
+        // coordinates out of range are clamped, so they never overwrite neighbouring fields of the packed position
+        static inline Edit create(VoxelPosition position, Voxel voxel) {
+            VOXEL_ENGINE_ASSERT(isValidPosition(position));
+            u32 x = std::min(position.x, COORD_MASK);
+            u32 y = std::min(position.y, COORD_MASK);
+            u32 z = std::min(position.z, COORD_MASK);
+            return { u32(position.scale) << (3 * COORD_BITS) | x | y << COORD_BITS | z << (2 * COORD_BITS), voxel };
+        }
+
+        inline VoxelPosition getPosition() const {
+            return { u8(position >> (3 * COORD_BITS)), position & COORD_MASK, (position >> COORD_BITS) & COORD_MASK, (position >> (2 * COORD_BITS)) & COORD_MASK };
+        }
+    };
+
+private:
+    struct ChunkEdits {
+        std::vector<Edit> edits;
+        // time in milliseconds, when edits were last added for the chunk
+        u64 last_added;
+    };
+
+    concurrent_flat_hash_map<ChunkPosition, ChunkEdits, 6> m_edits;
+    std::atomic<i64> m_edit_count = 0;
+
+public:
+    ChunkPendingEdits() = default;
+    ChunkPendingEdits(const ChunkPendingEdits&) = delete;
+    ChunkPendingEdits(ChunkPendingEdits&&) = delete;
+
+    // appends edits for the chunk at position, edits of the same chunk are applied in order they were added
+    void add(ChunkPosition position, const Edit* edits, i32 count);
+    // moves all edits of the chunk at position into output, returns false, if there are none
+    bool take(ChunkPosition position, std::vector<Edit>& output);
+    bool contains(ChunkPosition position) const;
+    // appends positions of all chunks, that have edits
+    void getPositions(std::vector<ChunkPosition>& output) const;
+    void clear();
+    // removes edits of chunks, that received no edits for max_age milliseconds, unless keep returns true for the
+    // chunk position, returns amount of removed edits
+    i64 removeExpired(u64 max_age, const std::function<bool(ChunkPosition)>& keep);
+
+    // amount of buffered edits and chunks, that have them
+    i64 getEditCount() const;
+    i64 getChunkCount() const;
+
+    // writes edits into the chunk buffer, chunk must be locked and not compressed
+    static void apply(Chunk& chunk, const std::vector<Edit>& edits);
+};
+
+} // voxel
+
+#endif //VOXEL_ENGINE_CHUNK_PENDING_EDITS_H
@@ -0,0 +1,92 @@
+#include "chunk_prefetcher.h"
+
+#include <algorithm>
+
+
+namespace voxel {
+
+ChunkPrefetcher::ChunkPrefetcher(Settings settings) : m_settings(settings) {
+}
+
+bool ChunkPrefetcher::isEnabled() const {
+    return m_settings.prefetch_time > 0;
+}
+
+void ChunkPrefetcher::updateCamera(math::Vec3f position, u64 time) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    f32 dt = m_last_update != 0 && time > m_last_update ? f32(time - m_last_update) / 1e9f : 0.0f;
+    math::Vec3f delta = position - m_position;
+    m_position = position;
+    m_last_update = time;
+    if (dt <= 0.0f) {
+        return;
+    }
+
+    // long pauses and teleports are not motion
+    if (dt > 1.0f || math::len(delta) > m_settings.teleport_distance) {
+        m_velocity = math::Vec3f(0.0f);
+        return;
+    }
+    // exponential smoothing, that does not depend on the rate of updates
+    f32 factor = m_settings.velocity_smoothing > 0 ? std::min(1.0f, dt / m_settings.velocity_smoothing) : 1.0f;
+    m_velocity += (delta / dt - m_velocity) * factor;
+}
+
+void ChunkPrefetcher::getMotion(math::Vec3f& position, math::Vec3f& velocity) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    position = m_position;
+    velocity = m_velocity;
+}
+
+math::Vec3f ChunkPrefetcher::getVelocity() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_velocity;
+}
+
+math::Vec3f ChunkPrefetcher::getPredictedPosition() {
+    math::Vec3f position, velocity;
+    getMotion(position, velocity);
+    f32 speed = math::len(velocity);
+    if (!isEnabled() || speed < m_settings.min_speed) {
+        return position;
+    }
+    f32 distance = std::min(speed * m_settings.prefetch_time, m_settings.max_distance);
+    return position + velocity * (distance / speed);
+}
+
+i32 ChunkPrefetcher::collectFetches(std::vector<ChunkSource::ChunkFetch>& fetches, i64 max_priority) {
+    math::Vec3f position, velocity;
+    getMotion(position, velocity);
+    f32 speed = math::len(velocity);
+    if (!isEnabled() || speed < m_settings.min_speed) {
+        return 0;
+    }
+    f32 distance = std::min(speed * m_settings.prefetch_time, m_settings.max_distance);
+    math::Vec3f direction = velocity / speed;
+
+    // path is sampled once per chunk, starting, where its neighbourhood stops overlapping the camera chunk
+    i32 radius = m_settings.radius;
+    i32 count = 0;
+    m_collected.clear();
+    for (f32 d = std::min(f32(radius), distance); d <= distance && count < m_settings.max_fetches; d += 1.0f) {
+        math::Vec3i center = math::floor_to_int(position + direction * d);
+        i64 priority = max_priority - i64(63.0f * d / distance);
+        for (i32 x = -radius; x <= radius && count < m_settings.max_fetches; x++) {
+            for (i32 y = -radius; y <= radius && count < m_settings.max_fetches; y++) {
+                for (i32 z = -radius; z <= radius && count < m_settings.max_fetches; z++) {
+                    if (x * x + y * y + z * z > radius * radius) {
+                        continue;
+                    }
+                    ChunkPosition chunk_position(center.x + x, center.y + y, center.z + z);
+                    if (m_collected.emplace(chunk_position).second) {
+                        fetches.push_back({ chunk_position, priority });
+                        count++;
+                    }
+                }
+            }
+        }
+    }
+    return count;
+}
+
+} // voxel
@@ -0,0 +1,76 @@
+#ifndef VOXEL_ENGINE_CHUNK_PREFETCHER_H
+#define VOXEL_ENGINE_CHUNK_PREFETCHER_H
+
+#include <mutex>
+#include <vector>
+#include "voxel/common/base.h"
+#include "voxel/common/math/vec.h"
+#include "voxel/engine/world/chunk_source.h"
+
+
+namespace voxel {
+
+/*
+ * Predicts camera motion and prefetches chunks along the predicted path, so chunks ahead of a fast camera are
+ * requested before the camera reaches them, instead of when they become visible. Camera velocity is smoothed over
+ * time, path is extrapolated linearly for a few seconds and chunks around it are fetched in order of predicted
+ * arrival, with priorities decreasing with arrival time. Camera position is in chunks.
+ */
+class ChunkPrefetcher {
+public:
+    struct Settings {
+        // how far ahead in seconds camera path is predicted, 0 disables prefetching
+        f32 prefetch_time = 3.0f;
+
+        // camera, that moves slower, than this amount of chunks per second, is considered standing
+        f32 min_speed = 1.0f;
+
+        // max length of predicted path in chunks
+        f32 max_distance = 64.0f;
+
+        // chunks within this distance from the predicted path are prefetched
+        i32 radius = 3;
+
+        // max chunks, prefetched each tick
+        i32 max_fetches = 512;
+
+        // time in seconds for velocity to follow camera motion, larger values ignore shorter changes of direction
+        f32 velocity_smoothing = 0.25f;
+
+        // camera moves further at once are teleports and reset velocity
+        f32 teleport_distance = 16.0f;
+    };
+
+private:
+    Settings m_settings;
+
+    std::mutex m_mutex;
+    math::Vec3f m_position = math::Vec3f(0.0f);
+    math::Vec3f m_velocity = math::Vec3f(0.0f);
+    u64 m_last_update = 0;
+
+    // reused between collectFetches calls
+    flat_hash_set<ChunkPosition> m_collected;
+
+public:
+    explicit ChunkPrefetcher(Settings settings);
+
+    bool isEnabled() const;
+
+    // updates camera position and velocity, can be called from any thread, time is in nanoseconds
+    void updateCamera(math::Vec3f position, u64 time);
+    math::Vec3f getVelocity();
+    // predicted camera position at the end of predicted path
+    math::Vec3f getPredictedPosition();
+
+    // appends fetches of chunks along the predicted path, nearest in time first, first chunks get max_priority,
+    // and the last ones - max_priority - 63, returns amount of appended fetches, 0, if camera is standing
+    i32 collectFetches(std::vector<ChunkSource::ChunkFetch>& fetches, i64 max_priority);
+
+private:
+    void getMotion(math::Vec3f& position, math::Vec3f& velocity);
+};
+
+} // voxel
+
+#endif //VOXEL_ENGINE_CHUNK_PREFETCHER_H
@@ -2,6 +2,7 @@
 
 #include "voxel/engine/world/chunk.h"
 #include "voxel/engine/world/chunk_source.h"
+#include "voxel/engine/world/chunk_neighborhood.h"
 
 
 namespace voxel {
@@ -22,4 +23,16 @@ bool ChunkProvider::processChunk(ChunkSource& chunk_source, Chunk& chunk) {
     return true;
 }
 
+bool ChunkProvider::requiresNeighborsForProcessing() {
+    return false;
+}
+
+bool ChunkProvider::processChunkWithNeighbors(ChunkSource& chunk_source, Chunk& chunk, const ChunkNeighborhood& neighborhood) {
+    return processChunk(chunk_source, chunk);
+}
+
+bool ChunkProvider::getGenerationIdentity(GenerationIdentity& identity) {
+    return false;
+}
+
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #ifndef VOXEL_ENGINE_CHUNK_PROVIDER_H
 #define VOXEL_ENGINE_CHUNK_PROVIDER_H
 
+#include <string>
 #include "voxel/common/base.h"
 #include "voxel/engine/shared/chunk_position.h"
 
@@ -9,9 +10,19 @@ namespace voxel {
 
 class Chunk;
 class ChunkSource;
+class ChunkNeighborhood;
 
 class ChunkProvider {
 public:
+    // identifies generated content: providers with the same identity must generate the same chunk for the same position
+    struct GenerationIdentity {
+        // provider type and its settings, that affect generation, except seed
+        std::string provider_id;
+        // must be incremented on every change of generation algorithm
+        u32 provider_version = 0;
+        u64 seed = 0;
+    };
+
     // Quick check, if chunk at position can be created,
     virtual bool canFetchChunk(ChunkSource& chunk_source, ChunkPosition position);
 
@@ -23,6 +34,16 @@ public:
 
     // Handle chunk processing task, return true, if succeeded
     virtual bool processChunk(ChunkSource& chunk_source, Chunk& chunk);
+
+    // If true, chunk is processed only after all its fetchable neighbours are built, using processChunkWithNeighbors
+    virtual bool requiresNeighborsForProcessing();
+
+    // Handle chunk processing task with read-only access to its neighbours, return true, if succeeded
+    virtual bool processChunkWithNeighbors(ChunkSource& chunk_source, Chunk& chunk, const ChunkNeighborhood& neighborhood);
+
+    // If returns true, generated chunks are deterministic and can be stored in the generation cache under given identity,
+    // providers, that add pending edits for other chunks, must return false, cached chunks would miss edits of neighbours
+    virtual bool getGenerationIdentity(GenerationIdentity& identity);
 };
 
 }
@@ -0,0 +1,74 @@
+#include "chunk_provider_registry.h"
+
+#include <cstdlib>
+#include "voxel/engine/world/terrain_chunk_provider.h"
+
+
+namespace voxel {
+
+ChunkProviderRegistry::ChunkProviderRegistry() {
+    registerProvider("terrain", "procedural heightmap terrain with biomes, arguments: seed, chunk_scale, min_chunk_y, "
+                                "max_chunk_y, base_height, hills_height, mountains_height, terrain_scale, biome_scale, soil_depth",
+                     [] (const Arguments& arguments) -> Unique<ChunkProvider> {
+        TerrainChunkProvider::Settings settings;
+        settings.seed = u32(getInteger(arguments, "seed", settings.seed));
+        settings.chunk_scale = u8(getInteger(arguments, "chunk_scale", settings.chunk_scale));
+        settings.min_chunk_y = i32(getInteger(arguments, "min_chunk_y", settings.min_chunk_y));
+        settings.max_chunk_y = i32(getInteger(arguments, "max_chunk_y", settings.max_chunk_y));
+        settings.base_height = i32(getInteger(arguments, "base_height", settings.base_height));
+        settings.hills_height = i32(getInteger(arguments, "hills_height", settings.hills_height));
+        settings.mountains_height = i32(getInteger(arguments, "mountains_height", settings.mountains_height));
+        settings.terrain_scale = f32(getFloat(arguments, "terrain_scale", settings.terrain_scale));
+        settings.biome_scale = f32(getFloat(arguments, "biome_scale", settings.biome_scale));
+        settings.soil_depth = i32(getInteger(arguments, "soil_depth", settings.soil_depth));
+        return CreateUnique<TerrainChunkProvider>(settings);
+    });
+}
+
+ChunkProviderRegistry& ChunkProviderRegistry::get() {
+    static ChunkProviderRegistry registry;
+    return registry;
+}
+
+void ChunkProviderRegistry::registerProvider(const std::string& name, const std::string& description, Factory factory) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (auto& entry : m_entries) {
+        if (entry.name == name) {
+            entry.description = description;
+            entry.factory = std::move(factory);
+            return;
+        }
+    }
+    m_entries.push_back({ name, description, std::move(factory) });
+}
+
+Unique<ChunkProvider> ChunkProviderRegistry::createProvider(const std::string& name, const Arguments& arguments) {
+    Factory factory;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (auto& entry : m_entries) {
+            if (entry.name == name) {
+                factory = entry.factory;
+                break;
+            }
+        }
+    }
+    return factory ? factory(arguments) : nullptr;
+}
+
+std::vector<ChunkProviderRegistry::Entry> ChunkProviderRegistry::getEntries() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_entries;
+}
+
+i64 ChunkProviderRegistry::getInteger(const Arguments& arguments, const std::string& key, i64 default_value) {
+    auto it = arguments.find(key);
+    return it != arguments.end() ? std::strtoll(it->second.c_str(), nullptr, 10) : default_value;
+}
+
+f64 ChunkProviderRegistry::getFloat(const Arguments& arguments, const std::string& key, f64 default_value) {
+    auto it = arguments.find(key);
+    return it != arguments.end() ? std::strtod(it->second.c_str(), nullptr) : default_value;
+}
+
+} // voxel
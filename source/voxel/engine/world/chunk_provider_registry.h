@@ -0,0 +1,53 @@
+#ifndef VOXEL_ENGINE_CHUNK_PROVIDER_REGISTRY_H
+#define VOXEL_ENGINE_CHUNK_PROVIDER_REGISTRY_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <functional>
+#include "voxel/common/base.h"
+#include "voxel/engine/world/chunk_provider.h"
+
+
+namespace voxel {
+
+/*
+ * Named factories of chunk providers, so tools can create any provider by name and string arguments without
+ * depending on its type. Built-in providers, that can be created without external data, are registered on
+ * first access, games register their own providers before running tools or loading worlds by provider name.
+ */
+class ChunkProviderRegistry {
+public:
+    // provider arguments as key=value pairs, factories use defaults for missing keys
+    using Arguments = flat_hash_map<std::string, std::string>;
+    using Factory = std::function<Unique<ChunkProvider>(const Arguments& arguments)>;
+
+    struct Entry {
+        std::string name;
+        std::string description;
+        Factory factory;
+    };
+
+private:
+    std::mutex m_mutex;
+    std::vector<Entry> m_entries;
+
+    ChunkProviderRegistry();
+
+public:
+    static ChunkProviderRegistry& get();
+
+    // registers provider factory, replaces existing one with the same name
+    void registerProvider(const std::string& name, const std::string& description, Factory factory);
+    // returns empty pointer, if there is no provider with this name
+    Unique<ChunkProvider> createProvider(const std::string& name, const Arguments& arguments);
+    std::vector<Entry> getEntries();
+
+    // parses argument value, returns default value, if argument is missing
+    static i64 getInteger(const Arguments& arguments, const std::string& key, i64 default_value);
+    static f64 getFloat(const Arguments& arguments, const std::string& key, f64 default_value);
+};
+
+} // voxel
+
+#endif //VOXEL_ENGINE_CHUNK_PROVIDER_REGISTRY_H
@@ -0,0 +1,49 @@
+#include "chunk_slot_map.h"
+
+
+namespace voxel {
+
+ChunkSlotMap::~ChunkSlotMap() {
+    for (auto& page : m_pages) {
+        delete[] page.load();
+    }
+}
+
+ChunkHandle ChunkSlotMap::insert(Chunk* chunk) {
+    u32 index;
+    {
+        std::unique_lock<std::mutex> lock(m_free_slots_mutex);
+        if (!m_free_slots.empty()) {
+            index = m_free_slots.back();
+            m_free_slots.pop_back();
+        } else {
+            index = m_slot_count++;
+            u32 page_index = index >> PAGE_BITS;
+            if (page_index >= u32(MAX_PAGES)) {
+                throw std::bad_alloc();
+            }
+            // pages are allocated under the free slots mutex, readers only see fully constructed pages
+            if (m_pages[page_index].load(std::memory_order_relaxed) == nullptr) {
+                m_pages[page_index].store(new Slot[PAGE_SIZE], std::memory_order_release);
+            }
+        }
+    }
+
+    Slot* slot = getSlot(ChunkHandle(index, 0));
+    std::unique_lock<std::mutex> lock(m_locks[index % LOCK_STRIPES]);
+    slot->chunk = chunk;
+    m_size++;
+    return ChunkHandle(index, slot->generation);
+}
+
+void ChunkSlotMap::releaseSlot(u32 index) {
+    m_size--;
+    std::unique_lock<std::mutex> lock(m_free_slots_mutex);
+    m_free_slots.emplace_back(index);
+}
+
+i32 ChunkSlotMap::getSize() const {
+    return m_size;
+}
+
+} // voxel
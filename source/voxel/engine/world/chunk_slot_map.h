@@ -0,0 +1,121 @@
+#ifndef VOXEL_ENGINE_CHUNK_SLOT_MAP_H
+#define VOXEL_ENGINE_CHUNK_SLOT_MAP_H
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "voxel/common/base.h"
+#include "voxel/engine/world/chunk.h"
+
+
+namespace voxel {
+
+/*
+ * Slot map of chunks, that resolves chunk handles in O(1) without hashing. Slots are allocated in pages, that are
+ * never moved or freed, so slot address is stable, removed slots are reused and their generation is incremented,
+ * so old handles do not resolve. Slots are guarded by striped locks, slot lock is held, while accessor callback
+ * runs, so chunk cannot be removed, before it is pinned or locked by the accessor.
+ */
+class ChunkSlotMap {
+public:
+    static const i32 PAGE_BITS = 10;
+    static const i32 PAGE_SIZE = 1 << PAGE_BITS;
+    static const i32 MAX_PAGES = 4096;
+    static const i32 LOCK_STRIPES = 64;
+
+private:
+    struct Slot {
+        Chunk* chunk = nullptr;
+        u32 generation = 1;
+    };
+
+    std::atomic<Slot*> m_pages[MAX_PAGES] = {};
+    std::mutex m_locks[LOCK_STRIPES];
+
+    std::mutex m_free_slots_mutex;
+    std::vector<u32> m_free_slots;
+    u32 m_slot_count = 0;
+    std::atomic<i32> m_size = 0;
+
+public:
+    ChunkSlotMap() = default;
+    ChunkSlotMap(const ChunkSlotMap&) = delete;
+    ChunkSlotMap(ChunkSlotMap&&) = delete;
+    ~ChunkSlotMap();
+
+    // puts chunk into a free slot and returns its handle, chunk is not owned by the slot map
+    ChunkHandle insert(Chunk* chunk);
+
+    // calls func with the chunk and its slot locked, returns false, if handle does not resolve
+    template<typename Func>
+    inline bool access(const ChunkHandle& handle, Func func) {
+        Slot* slot = getSlot(handle);
+        if (slot == nullptr) {
+            return false;
+        }
+        std::unique_lock<std::mutex> lock(m_locks[handle.index % LOCK_STRIPES]);
+        if (slot->generation != handle.generation || slot->chunk == nullptr) {
+            return false;
+        }
+        func(*slot->chunk);
+        return true;
+    }
+
+    // removes chunk, if handle resolves and predicate, called with the slot locked, returns true
+    template<typename Predicate>
+    inline bool remove(const ChunkHandle& handle, Predicate can_remove) {
+        Slot* slot = getSlot(handle);
+        if (slot == nullptr) {
+            return false;
+        }
+        {
+            std::unique_lock<std::mutex> lock(m_locks[handle.index % LOCK_STRIPES]);
+            if (slot->generation != handle.generation || slot->chunk == nullptr || !can_remove(*slot->chunk)) {
+                return false;
+            }
+            slot->chunk = nullptr;
+            slot->generation++;
+        }
+        releaseSlot(handle.index);
+        return true;
+    }
+
+    inline bool remove(const ChunkHandle& handle) {
+        return remove(handle, [] (Chunk&) -> bool { return true; });
+    }
+
+    // calls func for each chunk with its slot locked
+    template<typename Func>
+    void forEach(Func func) {
+        u32 slot_count;
+        {
+            std::unique_lock<std::mutex> lock(m_free_slots_mutex);
+            slot_count = m_slot_count;
+        }
+        for (u32 index = 0; index < slot_count; index++) {
+            Slot* slot = getSlot(ChunkHandle(index, 0));
+            std::unique_lock<std::mutex> lock(m_locks[index % LOCK_STRIPES]);
+            if (slot->chunk != nullptr) {
+                func(*slot->chunk);
+            }
+        }
+    }
+
+    // amount of chunks in the slot map
+    i32 getSize() const;
+
+private:
+    inline Slot* getSlot(const ChunkHandle& handle) const {
+        if (!handle.valid() || (handle.index >> PAGE_BITS) >= u32(MAX_PAGES)) {
+            return nullptr;
+        }
+        Slot* page = m_pages[handle.index >> PAGE_BITS].load(std::memory_order_acquire);
+        return page != nullptr ? page + (handle.index & (PAGE_SIZE - 1)) : nullptr;
+    }
+
+    void releaseSlot(u32 index);
+};
+
+} // voxel
+
+#endif //VOXEL_ENGINE_CHUNK_SLOT_MAP_H
@@ -2,9 +2,15 @@
 
 #include <iostream>
 #include <functional>
+#include <algorithm>
+#include <cctype>
+#include <limits>
 #include "voxel/common/profiler.h"
+#include "voxel/common/logger.h"
+#include "voxel/common/utils/time.h"
 #include "voxel/engine/world/chunk_provider.h"
 #include "voxel/engine/world/chunk_storage.h"
+#include "voxel/engine/world/chunk_neighborhood.h"
 
 
 namespace voxel {
@@ -12,6 +18,12 @@ namespace voxel {
 void ChunkSourceListener::onChunkSourceTick(ChunkSource& chunk_source) {}
 void ChunkSourceListener::onChunkUpdated(ChunkSource& chunk_source, ChunkRef chunk_ref) {}
 
+void ChunkSourceListener::onChunksUpdated(ChunkSource& chunk_source, const std::vector<ChunkRef>& chunk_refs) {
+    for (auto& chunk_ref : chunk_refs) {
+        onChunkUpdated(chunk_source, chunk_ref);
+    }
+}
+
 
 ChunkSource::LoadingRegion::LoadingRegion(ChunkSource* chunk_source, math::Vec3i position, i32 loading_level) :
         m_chunk_source(chunk_source), m_position(position), m_loading_level(loading_level) {
@@ -21,27 +33,111 @@ math::Vec3i ChunkSource::LoadingRegion::getPosition() {
     return m_position;
 }
 
+template<typename Func>
+void ChunkSource::LoadingRegion::updateGridRegion(Func change) {
+    if (m_chunk_source == nullptr) {
+        change();
+        return;
+    }
+
+    ThreadLock lock(m_chunk_source->m_loaded_regions_mutex);
+    LoadingLevelGrid::Region old_region = getGridRegion();
+    change();
+    LoadingLevelGrid::Region new_region = getGridRegion();
+    m_chunk_source->updateLoadingLevelGrid(&old_region, &new_region);
+}
+
 void ChunkSource::LoadingRegion::setPosition(math::Vec3i position) {
-    m_position = position;
+    math::Vec3i delta = position - m_position;
+    updateGridRegion([&] () {
+        m_position = position;
+    });
+
+    // after a jump queued tasks are most likely for chunks, that are no longer required
+    if (m_chunk_source != nullptr && m_cancels_tasks_on_jump && std::max(abs(delta.x), std::max(abs(delta.y), abs(delta.z))) > m_chunk_source->m_settings.region_jump_distance) {
+        m_chunk_source->cancelAllChunkTasks();
+    }
 }
 
 i32 ChunkSource::LoadingRegion::getLoadingLevel() {
     return m_loading_level;
 }
 
+void ChunkSource::LoadingRegion::setCancelsTasksOnJump(bool cancels_tasks) {
+    m_cancels_tasks_on_jump = cancels_tasks;
+}
+
+void ChunkSource::LoadingRegion::setView(math::Vec3f direction, f32 fov, i32 back_falloff) {
+    f32 direction_length = math::len(direction);
+    bool has_view = direction_length > 0.0f && back_falloff > 0;
+    math::Vec3f view_direction = has_view ? direction / direction_length : math::Vec3f(0.0f);
+    f32 view_cos = has_view ? f32(cos(std::min(fov, f32(M_PI * 2.0)) / 2.0f)) : 0.0f;
+    i32 view_falloff = has_view ? back_falloff : 0;
+    updateGridRegion([&] () {
+        m_view_direction = view_direction;
+        m_view_cos = view_cos;
+        m_view_falloff = view_falloff;
+    });
+}
+
+math::Vec3f ChunkSource::LoadingRegion::getViewDirection() {
+    return m_view_direction;
+}
+
+void ChunkSource::LoadingRegion::setShape(LoadingRegionShape shape, f32 vertical_scale) {
+    updateGridRegion([&] () {
+        m_shape = shape;
+        m_vertical_scale = vertical_scale > 0.0f ? vertical_scale : 1.0f;
+    });
+}
+
+LoadingRegionShape ChunkSource::LoadingRegion::getShape() {
+    return m_shape;
+}
+
+i32 ChunkSource::LoadingRegion::getLoadingLevelAt(ChunkPosition position) {
+    return std::max(0, getGridRegion().getLoadingLevel(position));
+}
+
+LoadingLevelGrid::Region ChunkSource::LoadingRegion::getGridRegion() {
+    return { this, m_position, m_loading_level, m_shape, m_vertical_scale, m_view_direction, m_view_cos, m_view_falloff };
+}
+
 ChunkSource::ChunkSource(
         Unique<ChunkProvider> provider,
         Unique<ChunkStorage> storage,
         Settings settings,
         ChunkSourceState initial_state) :
-        m_provider(std::move(provider)), m_storage(std::move(storage)), m_settings(settings), m_state(initial_state),
-        m_chunk_task_executor(
-                [this] () -> ChunkTask { return m_chunk_task_queue.pop(); },
-                [this] (ChunkTask task) -> void { runChunkTask(task); },
-                m_settings.worker_threads) {
+        m_provider(std::move(provider)), m_storage(std::move(storage)), m_state(initial_state),
+        m_chunk_metrics(m_metrics), m_last_metrics_log(utils::getTimestampMillis()), m_settings(settings),
+        m_chunk_updates(settings.chunk_update_resolution, utils::getTimestampMillis()),
+        m_chunk_task_pool(
+                [this] (const ChunkTask& task) -> void { runChunkTask(task); },
+                [] (const ChunkTaskKey& key) -> u64 {
+                    // chunks in the same 4x4x4 region share locality
+                    const ChunkPosition& position = key.position;
+                    return std::hash<ChunkPosition>()(ChunkPosition(position.x >> 2, position.y >> 2, position.z >> 2));
+                },
+                m_settings.worker_threads,
+                m_settings.shared_worker_pool,
+                m_settings.shared_worker_pool_name,
+                { m_settings.shared_worker_pool_weight, m_settings.shared_worker_pool_max_tasks }),
+        m_loading_level_grid(CreateShared<LoadingLevelGrid>()) {
+    m_chunk_task_pool.setDroppedTaskConsumer([this] (const ChunkTask& task) -> void { dropChunkTask(task); });
+    m_neighbor_processing = m_provider->requiresNeighborsForProcessing();
+    if (m_settings.generation_cache && m_provider->getGenerationIdentity(m_generation_identity)) {
+        m_generation_cache = m_settings.generation_cache;
+    }
+    if (m_settings.lazy_chunk_compression) {
+        m_lazy_compression_thread = CreateUnique<threading::WorkerThread>();
+    }
 }
 
 ChunkSource::~ChunkSource() {
+    // stop running chunk tasks and compressing chunks before everything else
+    m_chunk_task_pool.shutdown();
+    m_lazy_compression_thread.reset();
+
     {
         // detach all loaded regions
         ThreadLock lock(m_loaded_regions_mutex);
@@ -51,20 +147,22 @@ ChunkSource::~ChunkSource() {
     }
 
     {
-        ThreadLock lock(m_chunks_mutex);
-
-        // lock all chunks
-        for (auto& [pos, chunk] : m_chunks) {
-            chunk->getLock().lock();
+        // lock all chunks and move them to local variable, so they cannot be accessed and locked again from outside
+        std::vector<Unique<Chunk>> chunks;
+        std::vector<ThreadLock> shard_locks;
+        for (auto& shard : m_chunk_map_shards) {
+            shard_locks.emplace_back(shard);
+        }
+        for (auto& entry : m_chunks) {
+            entry.second->getLock().lock();
+            m_chunk_slots.remove(entry.second->getHandle());
+            chunks.emplace_back(std::move(entry.second));
         }
-
-        // move all chunks to local variable, so they cannot be accessed and locked again from outside
-        auto chunks = std::move(m_chunks);
         m_chunks.clear();
-        lock.unlock();
+        shard_locks.clear();
 
         // unlock all chunks
-        for (auto& [pos, chunk] : chunks) {
+        for (auto& chunk : chunks) {
             chunk->unlock();
         }
     }
@@ -93,145 +191,1018 @@ void ChunkSource::removeListener(ChunkSourceListener* listener) {
     }
 }
 
-void ChunkSource::tryCreateNewChunk(ChunkPosition position) {
+void ChunkSource::fetchChunk(Chunk& chunk, i64 priority) {
+    chunk.fetch();
+    auto chunk_state = chunk.getState();
+    if (chunk_state == CHUNK_LOADED) {
+    } else if (chunk_state == CHUNK_LAZY) {
+        tryLoadLazyChunk(chunk, priority);
+    } else {
+        queueChunkTask(chunk.getPosition(), TASK_LOAD, priority);
+    }
+}
+
+void ChunkSource::fetchMissingChunk(ChunkPosition position, i64 priority) {
+    if (m_provider->canFetchChunk(*this, position)) {
+        queueChunkTask(position, TASK_CREATE, priority);
+    }
+}
+
+bool ChunkSource::tryCreateNewChunk(ChunkPosition position) {
+    size_t hash = m_chunks.hash(position);
     {
-        ThreadLock lock(m_chunks_mutex);
-        if (m_chunks.find(position) != m_chunks.end()) {
-            return;
+        ThreadLock shard_lock(getChunkMapShard(hash));
+        if (m_chunks.find(position, hash) != m_chunks.end()) {
+            return false;
         }
     }
 
-    Unique<Chunk> chunk = m_provider->createChunk(*this, position);
+    Unique<Chunk> chunk;
+    {
+        MetricsRegistry::ScopedTimer timer(m_chunk_metrics.provider_create_chunk);
+        chunk = m_provider->createChunk(*this, position);
+    }
     if (!chunk) {
-        return;
+        return false;
     }
     chunk->setState(CHUNK_PENDING);
+    chunk->fetch();
+    i64 chunk_memory = chunk->updateAccountedMemory();
+    // handle is assigned before chunk becomes reachable by position
+    ChunkHandle handle = m_chunk_slots.insert(chunk.get());
+    chunk->setHandle(handle);
+    ChunkRef ref(*chunk);
 
+    // chunk is moved into the map only if it was not created by another thread,
+    // it is updated from the start, so it will be unloaded, if it is never loaded
+    bool is_added;
     {
-        ThreadLock lock(m_chunks_mutex);
-        if (m_chunks.find(position) == m_chunks.end()) {
-            chunk->fetch();
-            m_chunks.emplace(position, std::move(chunk));
-        }
+        ThreadLock shard_lock(getChunkMapShard(hash));
+        is_added = m_chunks.try_emplace(position, std::move(chunk)).second;
+    }
+    if (is_added) {
+        m_chunk_metrics.chunk_states[CHUNK_PENDING]->add(1);
+        addChunkMemory(chunk_memory);
+        scheduleChunkUpdate(ref, utils::getTimestampMillis() + m_settings.chunk_unload_timeout + 1);
+    } else {
+        m_chunk_slots.remove(handle);
     }
+    return is_added;
 }
 
-void ChunkSource::tryLoadLazyChunk(Chunk& chunk) {
-    chunk.setState(CHUNK_LOADED);
+void ChunkSource::setChunkState(Chunk& chunk, ChunkState state) {
+    m_chunk_metrics.chunk_states[chunk.getState()]->add(-1);
+    m_chunk_metrics.chunk_states[state]->add(1);
+    chunk.setState(state);
+}
+
+void ChunkSource::tryLoadLazyChunk(Chunk& chunk, i64 priority) {
+    if (!releaseLazyChunk(chunk)) {
+        // chunk contents were lost, it is loaded from storage or generated again
+        queueChunkTask(chunk.getPosition(), TASK_LOAD, priority);
+        return;
+    }
+    // edits, added while chunk was lazy, are applied only after its buffer is decompressed
+    if (applyPendingEdits(chunk)) {
+        accountChunkMemory(chunk);
+    }
+    setChunkState(chunk, CHUNK_LOADED);
     chunk.fetch();
     fireEventChunkUpdated(chunk);
 }
 
-void ChunkSource::startUpdatingChunk(Chunk& chunk) {
-    m_updates_queue.push(ChunkRef(chunk));
+void ChunkSource::scheduleChunkUpdate(ChunkRef ref, u64 time) {
+    ThreadLock lock(m_chunk_updates_mutex);
+    m_chunk_updates.schedule(ref, time);
 }
 
-bool ChunkSource::updateChunk(ChunkRef ref) {
-    bool continue_updating = true;
+void ChunkSource::updateChunk(ChunkRef ref) {
+    u64 now = utils::getTimestampMillis();
+    // busy chunk is updated again on the next tick, removed chunk is not updated anymore
+    u64 next_update = now + 1;
+
     accessChunk<chunk_access_policy_weak>(ref, [&](Chunk& chunk) {
+        // buffer of loaded chunk could be modified since the last update
+        accountChunkMemory(chunk);
+
+        // if chunk was fetched since its update was scheduled, it is updated again, when its new timeout expires
+        u64 timeout = chunk.getLastFetched() + m_settings.chunk_unload_timeout + 1;
+        bool is_timed_out = now >= timeout;
+        u64 next_check = is_timed_out ? now + m_settings.chunk_unload_timeout : timeout;
+
         auto state = chunk.getState();
         if (state == CHUNK_LOADED) {
-            if (chunk.getTimeSinceLastFetch() > m_settings.chunk_unload_timeout &&
-                getLoadingLevelForPosition(chunk.getPosition()) < LoadingRegion::LEVEL_LOAD) {
-                chunk.setState(CHUNK_LAZY);
+            if (is_timed_out && getLoadingLevelForPosition(chunk.getPosition()) < LoadingRegion::LEVEL_LOAD) {
+                setChunkState(chunk, CHUNK_LAZY);
+                startLazyChunk(chunk);
                 fireEventChunkUpdated(chunk);
+            } else {
+                next_update = next_check;
             }
         } else if (state == CHUNK_LAZY) {
-            if (chunk.getTimeSinceLastFetch() > m_settings.chunk_unload_timeout &&
-                getLoadingLevelForPosition(chunk.getPosition()) < LoadingRegion::LEVEL_LAZY) {
-                chunk.setState(CHUNK_STORING);
+            if (is_timed_out && getLoadingLevelForPosition(chunk.getPosition()) < LoadingRegion::LEVEL_LAZY) {
+                // chunk, that failed to decompress, is pending again and is unloaded without storing,
+                // edits, added while chunk was lazy, are stored with it
+                if (releaseLazyChunk(chunk)) {
+                    if (applyPendingEdits(chunk)) {
+                        accountChunkMemory(chunk);
+                    }
+                    setChunkState(chunk, CHUNK_STORING);
+                }
                 fireEventChunkUpdated(chunk);
+            } else {
+                // compression of lazy chunk, that was busy, is retried by its update
+                if (!chunk.isBufferCompressed()) {
+                    queueLazyChunkCompression(ref);
+                }
+                next_update = next_check;
             }
         } else if (state == CHUNK_STORING) {
-            if (m_storage->tryStoreChunk(*this, chunk)) {
-                chunk.setState(CHUNK_UNLOADING);
+            bool is_stored;
+            {
+                MetricsRegistry::ScopedTimer timer(m_chunk_metrics.stage_store);
+                is_stored = m_storage->tryStoreChunk(*this, chunk);
+            }
+            if (is_stored) {
+                setChunkState(chunk, CHUNK_UNLOADING);
             } else {
-                chunk.setState(CHUNK_LAZY);
+                setChunkState(chunk, CHUNK_LAZY);
+                startLazyChunk(chunk);
+                next_update = now + m_settings.chunk_unload_timeout;
             }
         } else if (state == CHUNK_UNLOADING) {
-            runChunkUnload(chunk);
-            continue_updating = false;
+            if (runChunkUnload(chunk)) {
+                next_update = 0;
+            }
+        } else if (state == CHUNK_PENDING || state == CHUNK_BUILT || state == CHUNK_PROCESSED) {
+            // chunk was never loaded, so there is nothing to store
+            if (is_timed_out && getLoadingLevelForPosition(chunk.getPosition()) < LoadingRegion::LEVEL_LAZY) {
+                if (state != CHUNK_PENDING) {
+                    m_chunk_metrics.wasted_builds++;
+                }
+                setChunkState(chunk, CHUNK_UNLOADING);
+            } else {
+                next_update = next_check;
+            }
+        } else {
+            next_update = 0;
+        }
+    }, [&] (bool exists) {
+        if (!exists) {
+            next_update = 0;
         }
     });
-    return continue_updating;
+
+    if (next_update != 0) {
+        scheduleChunkUpdate(ref, next_update);
+    }
 }
 
-void ChunkSource::handleLazyChunk(Chunk& chunk) {
+void ChunkSource::handleLazyChunk(Chunk& chunk, i64 priority) {
     if (m_state == STATE_UNLOADED) {
-        chunk.setState(CHUNK_STORING);
+        if (releaseLazyChunk(chunk)) {
+            if (applyPendingEdits(chunk)) {
+                accountChunkMemory(chunk);
+            }
+            setChunkState(chunk, CHUNK_STORING);
+        }
     } else {
         if (chunk.getTimeSinceLastFetch() < 1000) {
-            tryLoadLazyChunk(chunk);
+            tryLoadLazyChunk(chunk, priority);
         }
     }
 }
 
-void ChunkSource::handleChunkLoading(Chunk& chunk) {
+void ChunkSource::startLazyChunk(Chunk& chunk) {
+    m_lazy_chunk_memory += chunk.getAllocatedMemory();
+    queueLazyChunkCompression(ChunkRef(chunk));
+}
+
+void ChunkSource::queueLazyChunkCompression(ChunkRef ref) {
+    if (m_lazy_compression_thread && m_lazy_chunk_memory > m_settings.lazy_chunk_memory_target) {
+        m_lazy_compression_thread->queue([this, ref] () -> void { compressLazyChunk(ref); });
+    }
+}
+
+bool ChunkSource::releaseLazyChunk(Chunk& chunk) {
+    m_lazy_chunk_memory -= chunk.getAllocatedMemory();
+    if (!chunk.isBufferCompressed()) {
+        return true;
+    }
+
+    bool is_decompressed;
+    {
+        MetricsRegistry::ScopedTimer timer(m_chunk_metrics.lazy_chunk_decompress);
+        is_decompressed = chunk.decompressBuffer();
+    }
+    accountChunkMemory(chunk);
+    if (!is_decompressed) {
+        // buffer is left empty, so chunk must be loaded from storage or generated again, unsaved changes are lost
+        m_chunk_metrics.decompress_failures++;
+        Logger().message(Logger::flag_error, "ChunkSource", "failed to decompress lazy chunk %d %d %d, it will be built again",
+                         chunk.getPosition().x, chunk.getPosition().y, chunk.getPosition().z);
+        setChunkState(chunk, CHUNK_PENDING);
+    }
+    return is_decompressed;
+}
+
+void ChunkSource::compressLazyChunk(ChunkRef ref) {
+    bool is_busy = false;
+    accessChunk<chunk_access_policy_weak>(ref, [&] (Chunk& chunk) {
+        // chunk could be loaded again, while it was waiting in queue, or target could be already reached
+        if (chunk.getState() != CHUNK_LAZY || chunk.isBufferCompressed() ||
+            m_lazy_chunk_memory <= m_settings.lazy_chunk_memory_target) {
+            return;
+        }
+
+        i64 uncompressed_size = chunk.getAllocatedMemory();
+        chunk.compressBuffer();
+        i64 compressed_size = chunk.getAllocatedMemory();
+        m_lazy_chunk_memory += compressed_size - uncompressed_size;
+        accountChunkMemory(chunk);
+
+        m_chunk_metrics.compressed_chunks++;
+        m_chunk_metrics.uncompressed_bytes += uncompressed_size;
+        m_chunk_metrics.compressed_bytes += compressed_size;
+    }, [&] (bool exists) {
+        is_busy = exists;
+    });
+
+    // busy chunk is not polled in a loop, its update is brought closer instead and it queues compression again
+    if (is_busy) {
+        m_chunk_metrics.compression_retries++;
+        scheduleChunkUpdate(ref, utils::getTimestampMillis() + m_settings.lazy_compression_retry_delay);
+    }
+}
+
+void ChunkSource::accountChunkMemory(Chunk& chunk) {
+    addChunkMemory(chunk.updateAccountedMemory());
+}
+
+void ChunkSource::addChunkMemory(i64 delta) {
+    if (delta == 0) {
+        return;
+    }
+    i64 memory = m_chunk_memory += delta;
+    i64 peak = m_chunk_memory_peak;
+    while (memory > peak && !m_chunk_memory_peak.compare_exchange_weak(peak, memory));
+}
+
+void ChunkSource::enforceMemoryBudget() {
+    u64 now = utils::getTimestampMillis();
+    if (m_settings.memory_budget <= 0 || now - m_last_memory_budget_check < u64(m_settings.memory_budget_check_interval)) {
+        return;
+    }
+    m_last_memory_budget_check = now;
+    if (m_chunk_memory <= m_settings.memory_budget) {
+        return;
+    }
+
+    struct EvictionCandidate {
+        ChunkRef ref;
+        bool is_lazy;
+        f64 score;
+    };
+
+    // memory of chunks, that are already storing or unloading, will be released without new evictions
+    i64 releasing_memory = 0;
+    std::vector<EvictionCandidate> candidates;
+    Shared<const LoadingLevelGrid> grid = std::atomic_load(&m_loading_level_grid);
+    m_chunk_slots.forEach([&] (const Chunk& chunk) {
+        ChunkState state = chunk.getState();
+        i64 memory = chunk.getAccountedMemory();
+        if (state == CHUNK_STORING || state == CHUNK_UNLOADING || state == CHUNK_FINALIZED) {
+            releasing_memory += memory;
+            return;
+        }
+        if ((state != CHUNK_LAZY && state != CHUNK_LOADED) || memory <= 0) {
+            return;
+        }
+        i32 level = grid->getLoadingLevel(chunk.getPosition());
+        if (level >= m_settings.memory_budget_protected_level) {
+            return;
+        }
+
+        // cost of keeping chunk is its memory, benefit is lower for distant and long not fetched chunks
+        f64 distance = f64(m_settings.memory_budget_protected_level - level);
+        f64 idle_seconds = f64(chunk.getTimeSinceLastFetch()) / 1000.0;
+        candidates.push_back({ ChunkRef(chunk), state == CHUNK_LAZY, f64(memory) * distance * (1.0 + idle_seconds) });
+    });
+
+    i64 excess = m_chunk_memory - releasing_memory - m_settings.memory_budget;
+    if (excess <= 0 || candidates.empty()) {
+        return;
+    }
+
+    // all lazy chunks are evicted before loaded ones
+    std::sort(candidates.begin(), candidates.end(), [] (const EvictionCandidate& a, const EvictionCandidate& b) -> bool {
+        return a.is_lazy != b.is_lazy ? a.is_lazy : a.score > b.score;
+    });
+
+    for (auto& candidate : candidates) {
+        if (excess <= 0) {
+            break;
+        }
+        bool is_evicted = false;
+        accessChunk<chunk_access_policy_weak>(candidate.ref, [&] (Chunk& chunk) {
+            ChunkState state = chunk.getState();
+            if (state != CHUNK_LAZY && state != CHUNK_LOADED) {
+                return;
+            }
+            i64 memory = chunk.getAccountedMemory();
+            // chunk, that failed to decompress, has nothing to store
+            ChunkState evicted_state = CHUNK_STORING;
+            if (state == CHUNK_LAZY) {
+                if (!releaseLazyChunk(chunk)) {
+                    evicted_state = CHUNK_UNLOADING;
+                }
+                m_chunk_metrics.lazy_evictions++;
+            } else {
+                m_chunk_metrics.loaded_evictions++;
+            }
+            m_chunk_metrics.evicted_bytes += memory;
+            excess -= memory;
+            // edits, that were not applied yet, are stored with the chunk
+            if (evicted_state == CHUNK_STORING && applyPendingEdits(chunk)) {
+                accountChunkMemory(chunk);
+            }
+
+            // evicted chunk is stored and unloaded by its next updates
+            setChunkState(chunk, evicted_state);
+            fireEventChunkUpdated(chunk);
+            is_evicted = true;
+        });
+        if (is_evicted) {
+            scheduleChunkUpdate(candidate.ref, now + 1);
+        }
+    }
+}
+
+ChunkSource::MemoryBudgetStats ChunkSource::getMemoryBudgetStats() {
+    MemoryBudgetStats stats;
+    stats.memory_budget = m_settings.memory_budget;
+    stats.memory_usage = m_chunk_memory;
+    stats.peak_memory_usage = m_chunk_memory_peak;
+    stats.lazy_evictions = m_chunk_metrics.lazy_evictions;
+    stats.loaded_evictions = m_chunk_metrics.loaded_evictions;
+    stats.evicted_bytes = m_chunk_metrics.evicted_bytes;
+    return stats;
+}
+
+ChunkSource::LazyChunkCompressionStats ChunkSource::getLazyCompressionStats() {
+    LazyChunkCompressionStats stats;
+    stats.lazy_chunk_memory = m_lazy_chunk_memory;
+    stats.compressed_chunks = m_chunk_metrics.compressed_chunks;
+    stats.uncompressed_bytes = m_chunk_metrics.uncompressed_bytes;
+    stats.compressed_bytes = m_chunk_metrics.compressed_bytes;
+    stats.compression_retries = m_chunk_metrics.compression_retries;
+    stats.decompress_failures = m_chunk_metrics.decompress_failures;
+
+    auto decompress = m_chunk_metrics.lazy_chunk_decompress.getSnapshot();
+    stats.decompressed_chunks = decompress.count;
+    stats.total_decompress_time = decompress.total;
+    stats.max_decompress_time = decompress.max;
+    return stats;
+}
+
+f32 ChunkSource::LazyChunkCompressionStats::getCompressionRatio() const {
+    return compressed_bytes > 0 ? f32(uncompressed_bytes) / f32(compressed_bytes) : 0.0f;
+}
+
+f32 ChunkSource::LazyChunkCompressionStats::getAverageDecompressTime() const {
+    return decompressed_chunks > 0 ? f32(total_decompress_time / decompressed_chunks) : 0.0f;
+}
+
+ChunkSource::ChunkTaskStats ChunkSource::getChunkTaskStats() {
+    ChunkTaskStats stats;
+    stats.queued_tasks = m_chunk_metrics.queued_tasks;
+    stats.executed_tasks = m_chunk_metrics.executed_tasks;
+    stats.stale_tasks = m_chunk_metrics.stale_tasks;
+    stats.cancelled_tasks = m_chunk_metrics.cancelled_tasks;
+    stats.region_jumps = m_chunk_metrics.region_jumps;
+    stats.built_chunks = m_chunk_metrics.built_chunks;
+    stats.wasted_builds = m_chunk_metrics.wasted_builds;
+    {
+        ThreadLock lock(m_processing_mutex);
+        stats.waiting_chunks = i64(m_processing_waiting.size());
+        stats.awaited_neighbors = i64(m_processing_dependents.size());
+    }
+    return stats;
+}
+
+f32 ChunkSource::ChunkTaskStats::getWastedBuildRatio() const {
+    return built_chunks > 0 ? f32(wasted_builds) / f32(built_chunks) : 0.0f;
+}
+
+ChunkSource::ChunkMetrics::ChunkMetrics(MetricsRegistry& metrics) :
+        queued_tasks(metrics.getCounter("tasks_queued")),
+        executed_tasks(metrics.getCounter("tasks_executed")),
+        stale_tasks(metrics.getCounter("tasks_stale")),
+        cancelled_tasks(metrics.getCounter("tasks_cancelled")),
+        region_jumps(metrics.getCounter("region_jumps")),
+        built_chunks(metrics.getCounter("builds_total")),
+        wasted_builds(metrics.getCounter("builds_wasted")),
+        compressed_chunks(metrics.getCounter("lazy_compressed_chunks")),
+        uncompressed_bytes(metrics.getCounter("lazy_uncompressed_bytes")),
+        compressed_bytes(metrics.getCounter("lazy_compressed_bytes")),
+        compression_retries(metrics.getCounter("lazy_compression_retries")),
+        decompress_failures(metrics.getCounter("lazy_decompress_failures")),
+        storage_loads(metrics.getCounter("storage_loads")),
+        storage_hits(metrics.getCounter("storage_hits")),
+        storage_load_skips(metrics.getCounter("storage_load_skips")),
+        generation_cache_hits(metrics.getCounter("generation_cache_hits")),
+        generation_cache_misses(metrics.getCounter("generation_cache_misses")),
+        generation_cache_stores(metrics.getCounter("generation_cache_stores")),
+        lazy_evictions(metrics.getCounter("memory_budget_lazy_evictions")),
+        loaded_evictions(metrics.getCounter("memory_budget_loaded_evictions")),
+        evicted_bytes(metrics.getCounter("memory_budget_evicted_bytes")),
+        pending_edits_added(metrics.getCounter("pending_edits_added")),
+        pending_edits_applied(metrics.getCounter("pending_edits_applied")),
+        pending_edits_dropped(metrics.getCounter("pending_edits_dropped")),
+        pending_edits_expired(metrics.getCounter("pending_edits_expired")),
+        queued_chunk_tasks(metrics.getGauge("tasks_in_queue")),
+        scheduled_chunk_updates(metrics.getGauge("chunk_updates_scheduled")),
+        lazy_chunk_memory(metrics.getGauge("lazy_chunk_memory")),
+        chunk_memory(metrics.getGauge("chunk_memory")),
+        chunk_memory_peak(metrics.getGauge("chunk_memory_peak")),
+        pending_edits(metrics.getGauge("pending_edits")),
+        pending_edit_chunks(metrics.getGauge("pending_edit_chunks")),
+        stage_build(metrics.getHistogram("stage_build")),
+        stage_process(metrics.getHistogram("stage_process")),
+        stage_load(metrics.getHistogram("stage_load")),
+        stage_store(metrics.getHistogram("stage_store")),
+        stage_unload(metrics.getHistogram("stage_unload")),
+        provider_create_chunk(metrics.getHistogram("provider_create_chunk")),
+        provider_build_chunk(metrics.getHistogram("provider_build_chunk")),
+        provider_process_chunk(metrics.getHistogram("provider_process_chunk")),
+        lazy_chunk_decompress(metrics.getHistogram("lazy_chunk_decompress")),
+        generation_cache_load(metrics.getHistogram("generation_cache_load")),
+        generation_cache_store(metrics.getHistogram("generation_cache_store")) {
+    for (i32 state = CHUNK_PENDING; state <= CHUNK_FINALIZED; state++) {
+        // CHUNK_LOADED -> chunks_loaded
+        std::string name = std::to_string(ChunkState(state)).substr(6);
+        std::transform(name.begin(), name.end(), name.begin(), [] (char c) -> char { return char(std::tolower(c)); });
+        chunk_states[state] = &metrics.getGauge("chunks_" + name);
+    }
+}
+
+MetricsRegistry& ChunkSource::getMetrics() {
+    return m_metrics;
+}
+
+MetricsRegistry::Snapshot ChunkSource::getMetricsSnapshot() {
+    updateMetricGauges();
+    return m_metrics.getSnapshot();
+}
+
+void ChunkSource::updateMetricGauges() {
+    m_chunk_metrics.queued_chunk_tasks.set(m_chunk_task_pool.getQueuedTaskCount());
+    m_chunk_metrics.lazy_chunk_memory.set(m_lazy_chunk_memory);
+    m_chunk_metrics.chunk_memory.set(m_chunk_memory);
+    m_chunk_metrics.chunk_memory_peak.set(m_chunk_memory_peak);
+    m_chunk_metrics.pending_edits.set(m_pending_edits.getEditCount());
+    m_chunk_metrics.pending_edit_chunks.set(m_pending_edits.getChunkCount());
+    ThreadLock lock(m_chunk_updates_mutex);
+    m_chunk_metrics.scheduled_chunk_updates.set(m_chunk_updates.getSize());
+}
+
+void ChunkSource::handleChunkLoading(Chunk& chunk, i64 priority) {
     ChunkState state = chunk.getState();
     if (state == CHUNK_PENDING) {
-        if (m_storage->tryLoadChunk(*this, chunk)) {
-            chunk.setState(CHUNK_PROCESSED);
+        runChunkBuild(chunk);
+        // stored chunks are already processed
+        if (chunk.getState() == CHUNK_PROCESSED) {
             runChunkLoad(chunk);
-        } else {
-            runChunkBuild(chunk);
         }
     } else if (state == CHUNK_BUILT) {
-        runChunkProcessing(chunk);
+        if (m_neighbor_processing) {
+            scheduleChunkProcessing(chunk.getPosition(), priority);
+        } else {
+            runChunkProcessing(chunk);
+        }
     } else if (state == CHUNK_PROCESSED) {
         runChunkLoad(chunk);
     } else if (state == CHUNK_LAZY) {
-        handleLazyChunk(chunk);
+        handleLazyChunk(chunk, priority);
     }
 }
 
 void ChunkSource::runChunkBuild(Chunk& chunk) {
-    if (m_provider->buildChunk(*this, chunk)) {
-        chunk.setState(CHUNK_BUILT);
+    MetricsRegistry::ScopedTimer stage_timer(m_chunk_metrics.stage_build);
+    bool is_built = false;
+    if (tryLoadStoredChunk(chunk) || tryLoadGeneratedChunk(chunk)) {
+        setChunkState(chunk, CHUNK_PROCESSED);
+        applyPendingEdits(chunk);
+        accountChunkMemory(chunk);
+    } else {
+        {
+            MetricsRegistry::ScopedTimer timer(m_chunk_metrics.provider_build_chunk);
+            is_built = m_provider->buildChunk(*this, chunk);
+        }
+        if (!is_built) {
+            accountChunkMemory(chunk);
+            return;
+        }
+        setChunkState(chunk, CHUNK_BUILT);
+        applyPendingEdits(chunk);
+        accountChunkMemory(chunk);
+        m_chunk_metrics.built_chunks++;
+    }
+    if (m_neighbor_processing) {
+        notifyChunkBuilt(chunk.getPosition());
     }
 }
 
 void ChunkSource::runChunkProcessing(Chunk& chunk) {
-    if (m_provider->processChunk(*this, chunk)) {
-        chunk.setState(CHUNK_PROCESSED);
+    MetricsRegistry::ScopedTimer stage_timer(m_chunk_metrics.stage_process);
+    bool is_processed;
+    {
+        MetricsRegistry::ScopedTimer timer(m_chunk_metrics.provider_process_chunk);
+        is_processed = m_provider->processChunk(*this, chunk);
+    }
+    accountChunkMemory(chunk);
+    if (is_processed) {
+        setChunkState(chunk, CHUNK_PROCESSED);
+        storeGeneratedChunk(chunk);
+    }
+}
+
+bool ChunkSource::tryLoadStoredChunk(Chunk& chunk) {
+    // chunks, that are known to be absent, go straight to generation without touching storage
+    if (!m_storage->mayContainChunk(*this, chunk.getPosition())) {
+        m_chunk_metrics.storage_load_skips++;
+        return false;
+    }
+    m_chunk_metrics.storage_loads++;
+    if (m_storage->tryLoadChunk(*this, chunk)) {
+        m_chunk_metrics.storage_hits++;
+        return true;
+    }
+    return false;
+}
+
+bool ChunkSource::tryLoadGeneratedChunk(Chunk& chunk) {
+    if (!m_generation_cache) {
+        return false;
+    }
+    MetricsRegistry::ScopedTimer timer(m_chunk_metrics.generation_cache_load);
+    if (m_generation_cache->tryLoadChunk(m_generation_identity, chunk)) {
+        m_chunk_metrics.generation_cache_hits++;
+        return true;
+    }
+    m_chunk_metrics.generation_cache_misses++;
+    return false;
+}
+
+void ChunkSource::storeGeneratedChunk(Chunk& chunk) {
+    if (!m_generation_cache) {
+        return;
+    }
+    MetricsRegistry::ScopedTimer timer(m_chunk_metrics.generation_cache_store);
+    if (m_generation_cache->storeChunk(m_generation_identity, chunk)) {
+        m_chunk_metrics.generation_cache_stores++;
+    }
+}
+
+void ChunkSource::addPendingEdits(ChunkPosition position, const ChunkPendingEdits::Edit* edits, i32 count) {
+    if (count <= 0) {
+        return;
+    }
+    if (!m_provider->canFetchChunk(*this, position)) {
+        reportDroppedEdits(m_chunk_metrics.pending_edits_dropped, position, count, "chunk cannot be fetched");
+        return;
+    }
+    // over the limit only chunks in memory or in storage take more edits, edits of stored chunks are written into
+    // storage right away, so the buffer shrinks, instead of being kept, until the timeout
+    bool is_over_limit = m_settings.max_pending_edits > 0 && m_pending_edits.getEditCount() + count > m_settings.max_pending_edits;
+    if (is_over_limit && !m_storage->mayContainChunk(*this, position)) {
+        bool is_in_memory = false;
+        accessChunk<chunk_access_policy_map_only>(ChunkRef(position), [&] (Chunk&) { is_in_memory = true; });
+        if (!is_in_memory) {
+            reportDroppedEdits(m_chunk_metrics.pending_edits_dropped, position, count, "pending edit limit is reached");
+            return;
+        }
+    }
+    m_pending_edits.add(position, edits, count);
+    m_chunk_metrics.pending_edits_added += count;
+
+    // edits are added before the chunk is looked up, so chunk, that is not found, will take them, when it is built,
+    // existing chunk is queued to take them on the next tick, if it is already built, or when it is built otherwise
+    bool exists = false;
+    accessChunk<chunk_access_policy_map_only>(ChunkRef(position), [&] (Chunk&) { exists = true; });
+    if (exists) {
+        m_edited_chunks.push(ChunkRef(position));
+    } else if (is_over_limit) {
+        queueChunkTask(position, TASK_STORE_EDITS, std::numeric_limits<i64>::max());
+    }
+}
+
+void ChunkSource::storePendingEdits() {
+    std::vector<ChunkPosition> positions;
+    m_pending_edits.getPositions(positions);
+    for (auto& position : positions) {
+        // chunks in memory take their edits, when they are built or loaded, and are stored, when unloaded
+        bool exists = false;
+        accessChunk<chunk_access_policy_map_only>(ChunkRef(position), [&] (Chunk&) { exists = true; });
+        if (!exists) {
+            queueChunkTask(position, TASK_STORE_EDITS, 0);
+        }
+    }
+}
+
+void ChunkSource::expirePendingEdits() {
+    // checked a few times per timeout, so edits live at most about 1.25 timeouts
+    u64 now = utils::getTimestampMillis();
+    if (m_settings.pending_edit_timeout <= 0 || now - m_last_pending_edit_expiry < u64(m_settings.pending_edit_timeout) / 4) {
+        return;
+    }
+    m_last_pending_edit_expiry = now;
+    // existing chunks take their edits, when they are built or loaded again, edits of stored chunks are written
+    // into storage, only edits of chunks, that were never created, are dropped
+    std::vector<ChunkPosition> stored_positions;
+    i64 expired = m_pending_edits.removeExpired(u64(m_settings.pending_edit_timeout), [&] (ChunkPosition position) {
+        bool exists = false;
+        accessChunk<chunk_access_policy_map_only>(ChunkRef(position), [&] (Chunk&) { exists = true; });
+        if (!exists && m_storage->mayContainChunk(*this, position)) {
+            stored_positions.emplace_back(position);
+            return true;
+        }
+        return exists;
+    });
+    if (expired > 0) {
+        m_chunk_metrics.pending_edits_expired += expired;
+        Logger().message(Logger::flag_warning, "ChunkSource", "dropped %lld expired pending edits of chunks, that were never created",
+                         (long long) expired);
+    }
+    for (auto& position : stored_positions) {
+        queueChunkTask(position, TASK_STORE_EDITS, 0);
+    }
+}
+
+void ChunkSource::runPendingEditsStore(ChunkPosition position) {
+    // chunk is created here, so nobody else loads it from storage, while its stored copy is rewritten,
+    // chunk, that is already in memory, takes its edits, when it is built or loaded
+    if (!m_pending_edits.contains(position) || !tryCreateNewChunk(position)) {
+        return;
+    }
+    bool is_missing = false;
+    bool is_loaded = false;
+    accessChunk<chunk_access_policy_weak>(ChunkRef(position), [&] (Chunk& chunk) {
+        if (chunk.getState() != CHUNK_PENDING) {
+            return;
+        }
+        if (!tryLoadStoredChunk(chunk)) {
+            is_missing = true;
+            return;
+        }
+        is_loaded = true;
+        applyPendingEdits(chunk);
+        accountChunkMemory(chunk);
+        // chunk is stored and unloaded by its next update, edits, added after that, wait, until it is loaded again
+        setChunkState(chunk, CHUNK_STORING);
+        scheduleChunkUpdate(ChunkRef(chunk), utils::getTimestampMillis());
+    });
+
+    if (is_loaded && m_neighbor_processing) {
+        notifyChunkBuilt(position);
+    }
+    if (is_missing) {
+        // created chunk is left pending, it is built, if fetched, or unloaded after the timeout otherwise
+        std::vector<ChunkPendingEdits::Edit> edits;
+        if (m_pending_edits.take(position, edits)) {
+            reportDroppedEdits(m_chunk_metrics.pending_edits_dropped, position, i64(edits.size()), "chunk is neither in memory nor in storage");
+        }
+    }
+}
+
+void ChunkSource::reportDroppedEdits(MetricsRegistry::Counter& counter, ChunkPosition position, i64 count, const char* reason) {
+    counter += count;
+    Logger().message(Logger::flag_warning, "ChunkSource", "dropped %lld pending edits of chunk %d %d %d: %s",
+                     (long long) count, position.x, position.y, position.z, reason);
+}
+
+void ChunkSource::updateEditedChunks() {
+    std::vector<ChunkRef> busy_chunks;
+    for (i32 i = 0; i < m_settings.edited_chunk_updates; i++) {
+        auto next = m_edited_chunks.tryPop();
+        if (!next.has_value()) {
+            break;
+        }
+        ChunkRef ref = next.value();
+        // pending chunks take edits, when they are built, lazy chunks - when they are loaded again, chunks, that are
+        // being stored or unloaded, take them after they are loaded from storage or built again
+        accessChunk<chunk_access_policy_weak>(ref, [&] (Chunk& chunk) {
+            auto state = chunk.getState();
+            if ((state == CHUNK_BUILT || state == CHUNK_PROCESSED || state == CHUNK_LOADED) && applyPendingEdits(chunk)) {
+                accountChunkMemory(chunk);
+                if (state == CHUNK_LOADED) {
+                    fireEventChunkUpdated(chunk);
+                }
+            }
+        }, [&] (bool exists) {
+            if (exists) {
+                busy_chunks.emplace_back(ref);
+            }
+        });
+    }
+    m_edited_chunks.pushAll(busy_chunks);
+}
+
+bool ChunkSource::applyPendingEdits(Chunk& chunk) {
+    if (!m_pending_edits.contains(chunk.getPosition())) {
+        return false;
+    }
+    std::vector<ChunkPendingEdits::Edit> edits;
+    if (!m_pending_edits.take(chunk.getPosition(), edits)) {
+        return false;
+    }
+    ChunkPendingEdits::apply(chunk, edits);
+    m_chunk_metrics.pending_edits_applied += i64(edits.size());
+    return true;
+}
+
+void ChunkSource::scheduleChunkProcessing(ChunkPosition position, i64 priority) {
+    std::vector<ChunkPosition> required_neighbors;
+    {
+        // state of neighbours is checked under the same lock, as notification, so it cannot be missed
+        ThreadLock lock(m_processing_mutex);
+        for (i32 dz = -1; dz <= 1; dz++) {
+            for (i32 dy = -1; dy <= 1; dy++) {
+                for (i32 dx = -1; dx <= 1; dx++) {
+                    ChunkPosition neighbor(position.x + dx, position.y + dy, position.z + dz);
+                    if (neighbor == position) {
+                        continue;
+                    }
+
+                    bool exists = false;
+                    bool built = false;
+                    accessChunk<chunk_access_policy_map_only>(ChunkRef(neighbor), [&] (Chunk& chunk) {
+                        exists = true;
+                        built = chunk.getState() != CHUNK_PENDING;
+                    });
+                    // neighbours, that cannot be fetched, are never built, so they are not awaited
+                    if (built || (!exists && !m_provider->canFetchChunk(*this, neighbor))) {
+                        continue;
+                    }
+                    m_processing_dependents[neighbor].insert(position);
+                    required_neighbors.emplace_back(neighbor);
+                }
+            }
+        }
+
+        if (required_neighbors.empty()) {
+            m_processing_waiting.erase(position);
+        } else {
+            m_processing_waiting[position] = { i32(required_neighbors.size()), priority };
+        }
+    }
+
+    if (required_neighbors.empty()) {
+        queueChunkTask(position, TASK_PROCESS, priority);
+    } else {
+        for (auto& neighbor : required_neighbors) {
+            queueChunkTask(neighbor, TASK_BUILD, priority);
+        }
+    }
+}
+
+void ChunkSource::notifyChunkBuilt(ChunkPosition position) {
+    std::vector<std::pair<ChunkPosition, i64>> ready_chunks;
+    {
+        ThreadLock lock(m_processing_mutex);
+        auto dependents = m_processing_dependents.find(position);
+        if (dependents == m_processing_dependents.end()) {
+            return;
+        }
+        for (auto& dependent : dependents->second) {
+            auto waiting = m_processing_waiting.find(dependent);
+            if (waiting != m_processing_waiting.end() && --waiting->second.missing_neighbors <= 0) {
+                ready_chunks.emplace_back(dependent, waiting->second.priority);
+                m_processing_waiting.erase(waiting);
+            }
+        }
+        m_processing_dependents.erase(dependents);
+    }
+
+    for (auto& ready : ready_chunks) {
+        queueChunkTask(ready.first, TASK_PROCESS, ready.second);
+    }
+}
+
+void ChunkSource::runChunkProcessingWithNeighbors(ChunkPosition position, i64 priority) {
+    // stage also includes time, spent waiting for neighbour locks
+    MetricsRegistry::ScopedTimer stage_timer(m_chunk_metrics.stage_process);
+
+    // pin chunk and all its existing neighbours, so they are not unloaded, while their locks are awaited
+    Chunk* chunks[ChunkNeighborhood::SIZE] = {};
+    std::vector<Chunk*> locked_chunks;
+    for (i32 dz = -1; dz <= 1; dz++) {
+        for (i32 dy = -1; dy <= 1; dy++) {
+            for (i32 dx = -1; dx <= 1; dx++) {
+                ChunkPosition neighbor(position.x + dx, position.y + dy, position.z + dz);
+                accessChunk<chunk_access_policy_map_only>(ChunkRef(neighbor), [&] (Chunk& chunk) {
+                    chunk.pin();
+                    chunks[ChunkNeighborhood::getIndex(dx, dy, dz)] = &chunk;
+                    locked_chunks.emplace_back(&chunk);
+                });
+            }
+        }
+    }
+
+    // chunks are always locked in the same order, so neighbouring processing tasks cannot deadlock
+    std::sort(locked_chunks.begin(), locked_chunks.end(), [] (Chunk* a, Chunk* b) {
+        const ChunkPosition& pa = a->getPosition();
+        const ChunkPosition& pb = b->getPosition();
+        return std::tie(pa.x, pa.y, pa.z) < std::tie(pb.x, pb.y, pb.z);
+    });
+    for (Chunk* chunk : locked_chunks) {
+        chunk->getLock().lock();
+    }
+
+    Chunk* center = chunks[ChunkNeighborhood::getIndex(0, 0, 0)];
+    bool is_built = center != nullptr && center->getState() == CHUNK_BUILT;
+    bool neighbors_ready = true;
+    ChunkNeighborhood neighborhood;
+    for (i32 dz = -1; dz <= 1 && is_built; dz++) {
+        for (i32 dy = -1; dy <= 1; dy++) {
+            for (i32 dx = -1; dx <= 1; dx++) {
+                i32 index = ChunkNeighborhood::getIndex(dx, dy, dz);
+                Chunk* neighbor = chunks[index];
+                if (neighbor == nullptr) {
+                    ChunkPosition neighbor_position(position.x + dx, position.y + dy, position.z + dz);
+                    neighbors_ready = neighbors_ready && !m_provider->canFetchChunk(*this, neighbor_position);
+                    continue;
+                }
+                if (neighbor->getState() == CHUNK_LAZY && neighbor->isBufferCompressed()) {
+                    // lazy neighbour must be readable, it will be compressed again later, if required,
+                    // neighbour, that failed to decompress, is pending and is built again by rescheduled processing
+                    if (releaseLazyChunk(*neighbor)) {
+                        startLazyChunk(*neighbor);
+                    }
+                }
+                if (neighbor->getState() == CHUNK_PENDING) {
+                    neighbors_ready = false;
+                }
+                neighborhood.m_chunks[index] = neighbor;
+            }
+        }
+    }
+
+    if (is_built && neighbors_ready) {
+        bool is_processed;
+        {
+            MetricsRegistry::ScopedTimer timer(m_chunk_metrics.provider_process_chunk);
+            is_processed = m_provider->processChunkWithNeighbors(*this, *center, neighborhood);
+        }
+        accountChunkMemory(*center);
+        if (is_processed) {
+            setChunkState(*center, CHUNK_PROCESSED);
+            storeGeneratedChunk(*center);
+        }
+    }
+
+    for (Chunk* chunk : locked_chunks) {
+        chunk->unlock();
+        chunk->unpin();
+    }
+
+    // some neighbour was unloaded, while chunk was waiting for processing
+    if (is_built && !neighbors_ready) {
+        scheduleChunkProcessing(position, priority);
     }
 }
 
 void ChunkSource::runChunkLoad(Chunk& chunk) {
-    chunk.setState(CHUNK_LOADED);
+    MetricsRegistry::ScopedTimer stage_timer(m_chunk_metrics.stage_load);
+    setChunkState(chunk, CHUNK_LOADED);
     chunk.fetch();
-    startUpdatingChunk(chunk);
+    scheduleChunkUpdate(ChunkRef(chunk), chunk.getLastFetched() + m_settings.chunk_unload_timeout + 1);
     fireEventChunkUpdated(chunk);
 }
 
-void ChunkSource::runChunkUnload(Chunk& chunk) {
-    ThreadLock lock(m_chunks_mutex);
+bool ChunkSource::runChunkUnload(Chunk& chunk) {
+    MetricsRegistry::ScopedTimer stage_timer(m_chunk_metrics.stage_unload);
+    // pinned chunk can be awaited by another thread, so it cannot be removed yet
+    Unique<Chunk> unloaded;
+    {
+        size_t hash = m_chunks.hash(chunk.getPosition());
+        ThreadLock shard_lock(getChunkMapShard(hash));
+        auto it = m_chunks.find(chunk.getPosition(), hash);
+        // pin check is done with the slot locked, so chunk cannot be pinned through its handle after it
+        if (it != m_chunks.end() && it->second.get() == &chunk &&
+                m_chunk_slots.remove(chunk.getHandle(), [] (Chunk& slot_chunk) -> bool { return !slot_chunk.isPinned(); })) {
+            unloaded = std::move(it->second);
+            m_chunks.erase(it);
+        }
+    }
+    if (!unloaded) {
+        return false;
+    }
+
+    if (m_neighbor_processing) {
+        ThreadLock lock(m_processing_mutex);
+        m_processing_waiting.erase(chunk.getPosition());
+        m_processing_dependents.erase(chunk.getPosition());
+    }
+
     chunk.deleteAllBuffers();
-    chunk.setState(CHUNK_FINALIZED);
-    m_chunks.erase(chunk.getPosition());
-    lock.unlock();
+    accountChunkMemory(chunk);
+    setChunkState(chunk, CHUNK_FINALIZED);
+    m_finalized_chunks.emplace_back(std::move(unloaded));
+    return true;
 }
 
 
 void ChunkSource::onTick() {
     VOXEL_ENGINE_PROFILE_SCOPE(chunk_source_tick)
+    // chunks, unloaded during previous tick, are no longer locked by anyone
+    m_chunk_metrics.chunk_states[CHUNK_FINALIZED]->add(-i64(m_finalized_chunks.size()));
+    m_finalized_chunks.clear();
+
     {
         VOXEL_ENGINE_PROFILE_SCOPE(chunk_source_update_chunks)
-        i32 updates_count = std::min(m_settings.loaded_chunk_updates, i32(m_updates_queue.getUnderlyingQueue().size()));
-        for (i32 i = 0; i < updates_count; i++) {
-            auto popped = m_updates_queue.tryPop();
-            if (popped.has_value()) {
-                if (updateChunk(popped.value())) {
-                    m_updates_queue.push(popped.value());
+        std::vector<ChunkRef> due_chunks;
+        {
+            ThreadLock lock(m_chunk_updates_mutex);
+            m_chunk_updates.advance(utils::getTimestampMillis());
+            for (i32 i = 0; i < m_settings.loaded_chunk_updates; i++) {
+                auto due = m_chunk_updates.pollExpired();
+                if (!due.has_value()) {
+                    break;
                 }
-            } else {
-                break;
+                due_chunks.emplace_back(due.value());
             }
         }
+        for (auto& ref : due_chunks) {
+            updateChunk(ref);
+        }
+        updateEditedChunks();
+        expirePendingEdits();
+        enforceMemoryBudget();
     }
+    fireEventChunksUpdated();
     fireEventTick();
+
+    u64 timestamp = utils::getTimestampMillis();
+    if (m_settings.metrics_log_interval > 0 && timestamp - m_last_metrics_log >= u64(m_settings.metrics_log_interval)) {
+        m_last_metrics_log = timestamp;
+        Logger().message(Logger::flag_info, "ChunkSource", "%s", getMetricsSnapshot().toString().c_str());
+    }
+}
+
+void ChunkSource::queueChunkTask(ChunkPosition position, ChunkTaskType type, i64 priority) {
+    m_chunk_metrics.queued_tasks++;
+    m_chunk_task_pool.submit({ position, type }, { position, type, priority, m_chunk_task_epoch });
+}
+
+void ChunkSource::dropChunkTask(const ChunkTask& task) {
+    // chunks, that wait for this neighbour, are scheduled again, when they are fetched next time
+    if (!m_neighbor_processing || task.type != TASK_BUILD) {
+        return;
+    }
+    ThreadLock lock(m_processing_mutex);
+    auto dependents = m_processing_dependents.find(task.position);
+    if (dependents == m_processing_dependents.end()) {
+        return;
+    }
+    for (auto& dependent : dependents->second) {
+        m_processing_waiting.erase(dependent);
+    }
+    m_processing_dependents.erase(dependents);
+}
+
+bool ChunkSource::isChunkTaskStale(const ChunkTask& task) {
+    // task was queued before the last loading region jump
+    if (task.epoch != m_chunk_task_epoch) {
+        m_chunk_metrics.cancelled_tasks++;
+        return true;
+    }
+    // loading regions could move away from the chunk, while task was in queue, without any regions
+    // chunks are kept only by fetches, so no task is stale, edits are stored mostly for chunks far from the regions
+    if (m_settings.stale_task_loading_level > 0 && task.type != TASK_STORE_EDITS) {
+        Shared<const LoadingLevelGrid> grid = std::atomic_load(&m_loading_level_grid);
+        if (!grid->isEmpty() && grid->getLoadingLevel(task.position) < m_settings.stale_task_loading_level) {
+            m_chunk_metrics.stale_tasks++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ChunkSource::cancelAllChunkTasks() {
+    // tasks, that are queued concurrently with old epoch, are dropped on dequeue
+    m_chunk_task_epoch++;
+    m_chunk_metrics.region_jumps++;
+    m_chunk_metrics.cancelled_tasks += m_chunk_task_pool.cancelAll();
 }
 
 void ChunkSource::runChunkTask(ChunkTask task) {
+    if (isChunkTaskStale(task)) {
+        dropChunkTask(task);
+        return;
+    }
+    m_chunk_metrics.executed_tasks++;
+
     switch (task.type) {
         case TASK_CREATE: {
             tryCreateNewChunk(task.position);
@@ -242,19 +1213,45 @@ void ChunkSource::runChunkTask(ChunkTask task) {
                 ChunkState state = chunk.getState();
                 if (state == CHUNK_LOADED) {
                 } else if (state == CHUNK_LAZY) {
-                    tryLoadLazyChunk(chunk);
+                    tryLoadLazyChunk(chunk, task.priority);
                 } else {
-                    handleChunkLoading(chunk);
+                    handleChunkLoading(chunk, task.priority);
                 }
             });
             break;
         }
+        case TASK_BUILD: {
+            tryCreateNewChunk(task.position);
+            bool is_built = false;
+            accessChunk<chunk_access_policy_weak>(ChunkRef(task.position), [&] (Chunk& chunk) {
+                if (chunk.getState() == CHUNK_PENDING) {
+                    runChunkBuild(chunk);
+                }
+                is_built = chunk.getState() != CHUNK_PENDING;
+            });
+            // chunk is busy or its build failed, it will not notify waiting chunks
+            if (!is_built) {
+                dropChunkTask(task);
+            }
+            break;
+        }
+        case TASK_PROCESS: {
+            runChunkProcessingWithNeighbors(task.position, task.priority);
+            break;
+        }
+        case TASK_STORE_EDITS: {
+            runPendingEditsStore(task.position);
+            break;
+        }
     }
 }
 
 const Shared<ChunkSource::LoadingRegion>& ChunkSource::addLoadingRegion(math::Vec3i position, i32 loading_level) {
     ThreadLock lock(m_loaded_regions_mutex);
-    return m_loaded_regions.emplace_back(CreateShared<LoadingRegion>(this, position, loading_level));
+    auto& region = m_loaded_regions.emplace_back(CreateShared<LoadingRegion>(this, position, loading_level));
+    LoadingLevelGrid::Region grid_region = region->getGridRegion();
+    updateLoadingLevelGrid(nullptr, &grid_region);
+    return region;
 }
 
 void ChunkSource::removeLoadingRegion(const Shared<LoadingRegion>& loading_region) {
@@ -263,19 +1260,25 @@ void ChunkSource::removeLoadingRegion(const Shared<LoadingRegion>& loading_regio
     auto it = std::find(m_loaded_regions.begin(), m_loaded_regions.end(), loading_region);
     if (it != m_loaded_regions.end()) {
         m_loaded_regions.erase(it);
+        LoadingLevelGrid::Region grid_region = loading_region->getGridRegion();
+        updateLoadingLevelGrid(&grid_region, nullptr);
     }
 }
 
 i32 ChunkSource::getLoadingLevelForPosition(ChunkPosition position) {
-    math::Vec3i pos0(position.x, position.y, position.z);
-    i32 level = 0;
+    return std::atomic_load(&m_loading_level_grid)->getLoadingLevel(position);
+}
 
-    ThreadLock lock(m_loaded_regions_mutex);
-    for (auto& region : m_loaded_regions) {
-        math::Vec3i delta = pos0 - region->getPosition();
-        level = std::max(level, region->getLoadingLevel() - std::max(abs(delta.x), std::max(abs(delta.y), abs(delta.z))));
+void ChunkSource::updateLoadingLevelGrid(const LoadingLevelGrid::Region* removed, const LoadingLevelGrid::Region* added) {
+    // must be called with loaded regions mutex locked, copy shares all cells, except modified ones
+    Shared<LoadingLevelGrid> grid = CreateShared<LoadingLevelGrid>(*m_loading_level_grid);
+    if (removed != nullptr) {
+        grid->removeRegion(*removed);
+    }
+    if (added != nullptr) {
+        grid->addRegion(*added);
     }
-    return level;
+    std::atomic_store(&m_loading_level_grid, Shared<const LoadingLevelGrid>(grid));
 }
 
 void ChunkSource::fireEventTick() {
@@ -285,8 +1288,25 @@ void ChunkSource::fireEventTick() {
 }
 
 void ChunkSource::fireEventChunkUpdated(Chunk& chunk) {
+    // chunk could be locked, so event is only recorded here
+    ThreadLock lock(m_changed_chunks_mutex);
+    m_changed_chunks.insert(ChunkRef(chunk));
+}
+
+void ChunkSource::fireEventChunksUpdated() {
+    VOXEL_ENGINE_PROFILE_SCOPE(chunk_source_chunks_updated)
+    std::vector<ChunkRef> chunk_refs;
+    {
+        ThreadLock lock(m_changed_chunks_mutex);
+        if (m_changed_chunks.empty()) {
+            return;
+        }
+        chunk_refs.assign(m_changed_chunks.begin(), m_changed_chunks.end());
+        m_changed_chunks.clear();
+    }
+
     for (auto listener : m_listeners) {
-        listener->onChunkUpdated(*this, chunk);
+        listener->onChunksUpdated(*this, chunk_refs);
     }
 }
 
@@ -2,14 +2,21 @@
 #define VOXEL_ENGINE_CHUNK_SOURCE_H
 
 #include <unordered_map>
+#include <algorithm>
 #include <queue>
 #include <mutex>
 
 #include "voxel/common/base.h"
 #include "voxel/common/threading.h"
+#include "voxel/common/metrics.h"
+#include "voxel/common/utils/timer_wheel.h"
 #include "voxel/engine/world/chunk.h"
 #include "voxel/engine/world/chunk_lock.h"
+#include "voxel/engine/world/chunk_slot_map.h"
+#include "voxel/engine/world/chunk_pending_edits.h"
 #include "voxel/engine/world/chunk_provider.h"
+#include "voxel/engine/world/chunk_generation_cache.h"
+#include "voxel/engine/world/loading_level_grid.h"
 
 
 namespace voxel {
@@ -22,16 +29,20 @@ class ChunkSourceListener {
 public:
     virtual void onChunkSourceTick(ChunkSource& chunk_source);
     virtual void onChunkUpdated(ChunkSource& chunk_source, ChunkRef chunk_ref);
+
+    // called once per tick, before onChunkSourceTick, with all chunks, changed since previous tick, each chunk is present once,
+    // no chunks are locked, default implementation calls onChunkUpdated for each chunk
+    virtual void onChunksUpdated(ChunkSource& chunk_source, const std::vector<ChunkRef>& chunk_refs);
 };
 
 enum ChunkAccessPolicy {
-    // lock chunk on access, fail only when no chunk exist
+    // lock chunk on access, fail only when no chunk exist (chunk is pinned, while its lock is awaited, map is not locked)
     chunk_access_policy_strong = 1,
 
     // try lock chunk on access, fail, in case it cannot be locked or no chunk exist
     chunk_access_policy_weak,
 
-    // lock the map instead of locking the chunk
+    // lock the map shard or the slot, containing the chunk, instead of locking the chunk
     chunk_access_policy_map_only,
 
     // don't lock chunk at all (however it still locks the map, when querying position, use with extreme caution!)
@@ -52,17 +63,130 @@ public:
     };
 
     struct Settings {
-        // amount of chunk worker threads
+        // amount of chunk worker threads, ignored if shared worker pool is set
         i32 worker_threads = 4;
 
-        // max loaded chunks updates per tick
+        // run chunk tasks on the worker pool, shared with other chunk sources, instead of own threads
+        Shared<threading::SharedWorkerPool> shared_worker_pool;
+
+        // name, weight and max concurrent tasks of this chunk source in the shared worker pool
+        std::string shared_worker_pool_name = "chunk_source";
+        f32 shared_worker_pool_weight = 1;
+        i32 shared_worker_pool_max_tasks = 0;
+
+        // max chunk updates per tick, chunks, that are due, but were not updated, are updated on the next ticks
         i32 loaded_chunk_updates = 64;
 
+        // max chunks per tick, that apply pending edits, received after they were built
+        i32 edited_chunk_updates = 64;
+
+        // pending edits of chunks, that are not in memory and received no edits for this time in milliseconds, are written
+        // into storage, if chunk is stored, or dropped otherwise, 0 keeps them, until their chunks are built
+        i32 pending_edit_timeout = 300000;
+
+        // soft limit of buffered pending edits, over it edits of stored chunks are written into storage right away and
+        // edits of chunks, that are neither in memory nor in storage, are dropped, 0 disables the limit
+        i64 max_pending_edits = 1 << 22;
+
+        // resolution of chunk update timers in milliseconds
+        i32 chunk_update_resolution = 10;
+
         // time since last fetch for chunk to be checked for changing state to lazy or start unloading
         i32 chunk_unload_timeout = 10000;
+
+        // compress buffers of lazy chunks on a background thread, they are decompressed, when chunk is loaded again
+        bool lazy_chunk_compression = false;
+
+        // lazy chunks are compressed only while total memory of lazy chunk buffers exceeds this amount of bytes
+        i64 lazy_chunk_memory_target = 0;
+
+        // delay in milliseconds, after which compression of lazy chunk, that was busy, is retried by its update
+        i32 lazy_compression_retry_delay = 100;
+
+        // queued chunk tasks are dropped, if loading level for their position fell below this value, 0 disables the check,
+        // it is skipped, while there are no loading regions, so chunks can be fetched without them
+        i32 stale_task_loading_level = 1;
+
+        // moving loading region further than this amount of chunks at once cancels all queued chunk tasks
+        i32 region_jump_distance = 16;
+
+        // interval in milliseconds to log metrics snapshot from the ticking thread, 0 disables logging
+        i32 metrics_log_interval = 0;
+
+        // cache of generated chunks, used only if provider has generation identity, cache hits skip build and processing
+        Shared<ChunkGenerationCache> generation_cache;
+
+        // max total memory in bytes of all chunk buffers, when exceeded, lazy and then loaded chunks are evicted, 0 disables the budget
+        i64 memory_budget = 0;
+
+        // chunks with loading level at or above this value are never evicted to fit into the memory budget
+        i32 memory_budget_protected_level = LoadingRegion::LEVEL_LOAD;
+
+        // interval in milliseconds between memory budget checks on the ticking thread
+        i32 memory_budget_check_interval = 100;
+    };
+
+    struct ChunkTaskStats {
+        // total amount of queued and executed chunk tasks
+        i64 queued_tasks = 0;
+        i64 executed_tasks = 0;
+
+        // tasks, dropped on dequeue because of low loading level, and tasks, cancelled by loading region jumps
+        i64 stale_tasks = 0;
+        i64 cancelled_tasks = 0;
+        i64 region_jumps = 0;
+
+        // total amount of built chunks and chunks, that were discarded after build without ever being loaded
+        i64 built_chunks = 0;
+        i64 wasted_builds = 0;
+
+        // built chunks, waiting for their neighbours to be built for processing, and neighbours, they wait for
+        i64 waiting_chunks = 0;
+        i64 awaited_neighbors = 0;
+
+        f32 getWastedBuildRatio() const;
+    };
+
+    struct LazyChunkCompressionStats {
+        // memory in bytes, currently allocated for buffers of lazy chunks
+        i64 lazy_chunk_memory = 0;
+
+        // total amount of compressed buffers, their size before and after compression
+        i64 compressed_chunks = 0;
+        i64 uncompressed_bytes = 0;
+        i64 compressed_bytes = 0;
+
+        // total amount of compressions, retried because chunk was busy, and of buffers, that failed to decompress
+        i64 compression_retries = 0;
+        i64 decompress_failures = 0;
+
+        // total amount of decompressed buffers and time, spent on decompression in milliseconds
+        i64 decompressed_chunks = 0;
+        f64 total_decompress_time = 0;
+        f64 max_decompress_time = 0;
+
+        f32 getCompressionRatio() const;
+        f32 getAverageDecompressTime() const;
+    };
+
+    struct MemoryBudgetStats {
+        // memory budget, current and max memory in bytes, allocated for all chunk buffers
+        i64 memory_budget = 0;
+        i64 memory_usage = 0;
+        i64 peak_memory_usage = 0;
+
+        // total amount of evicted lazy and loaded chunks and memory in bytes, allocated for them at the moment of eviction
+        i64 lazy_evictions = 0;
+        i64 loaded_evictions = 0;
+        i64 evicted_bytes = 0;
+    };
+
+    struct ChunkFetch {
+        ChunkPosition position;
+        i64 priority;
     };
 
-    // TODO: LoadingRegion related logic is not thread-safe
+    // loading region changes are synchronized by chunk source, loading levels are read from the grid snapshot
     class LoadingRegion {
     public:
         static const i32 LEVEL_LOAD = 20;
@@ -72,15 +196,41 @@ public:
         ChunkSource* m_chunk_source;
         math::Vec3i m_position;
         i32 m_loading_level;
+        bool m_cancels_tasks_on_jump = true;
+        LoadingRegionShape m_shape = REGION_SHAPE_CUBE;
+        f32 m_vertical_scale = 1.0f;
+        math::Vec3f m_view_direction = math::Vec3f(0.0f);
+        f32 m_view_cos = 0.0f;
+        i32 m_view_falloff = 0;
 
     public:
         LoadingRegion(ChunkSource* chunk_source, math::Vec3i position, i32 loading_level);
         LoadingRegion(const LoadingRegion& other) = delete;
         LoadingRegion(LoadingRegion&& other) = delete;
 
+        LoadingLevelGrid::Region getGridRegion();
+
         math::Vec3i getPosition();
         void setPosition(math::Vec3i position);
         i32 getLoadingLevel();
+        // regions, that follow predictions rather than the camera itself, can move far at once without making queued tasks obsolete
+        void setCancelsTasksOnJump(bool cancels_tasks);
+        // lowers loading level outside of the view cone with given full angle in radians, up to back_falloff levels
+        // directly behind the region, so chunks behind the camera are kept lazy or unloaded earlier, than visible ones,
+        // zero direction or falloff makes region the same in all directions
+        void setView(math::Vec3f direction, f32 fov, i32 back_falloff);
+        math::Vec3f getViewDirection();
+        // distance metric of the region, LEVEL_LOAD and LEVEL_LAZY thresholds follow it, vertical_scale above 1
+        // shrinks vertical radius of the region by that factor, for mostly horizontal worlds
+        void setShape(LoadingRegionShape shape, f32 vertical_scale = 1.0f);
+        LoadingRegionShape getShape();
+        // level of this region alone at the given position
+        i32 getLoadingLevelAt(ChunkPosition position);
+
+    private:
+        // replaces region in the loading level grid after the change of its parameters
+        template<typename Func>
+        void updateGridRegion(Func change);
 
         friend ChunkSource;
     };
@@ -88,35 +238,158 @@ public:
 private:
     enum ChunkTaskType {
         TASK_CREATE,
-        TASK_LOAD
+        TASK_LOAD,
+        // create and build chunk, that is required to process its neighbour, it is not processed, until fetched itself
+        TASK_BUILD,
+        // process built chunk, after all its neighbours are built
+        TASK_PROCESS,
+        // write pending edits of the chunk, that is not in memory, into its stored copy
+        TASK_STORE_EDITS
     };
 
     struct ChunkTask {
         ChunkPosition position;
         ChunkTaskType type;
         i64 priority;
+        // task epoch at the moment of queuing, tasks from previous epochs are stale
+        u64 epoch;
+    };
+
+    // tasks of different types for the same position are queued separately, so one cannot replace another
+    struct ChunkTaskKey {
+        ChunkPosition position;
+        ChunkTaskType type;
+
+        inline bool operator==(const ChunkTaskKey& other) const {
+            return position == other.position && type == other.type;
+        }
 
-        inline bool operator<(const ChunkTask& other) const {
-            return priority < other.priority;
+        friend size_t hash_value(const ChunkTaskKey& key) {
+            return std::hash<ChunkPosition>()(key.position) * 31 + size_t(key.type);
         }
     };
 
+    struct ChunkProcessingDependency {
+        i32 missing_neighbors;
+        i64 priority;
+    };
+
+    // metrics of chunk source registry, referenced directly, so they are not looked up by name
+    struct ChunkMetrics {
+        MetricsRegistry::Counter& queued_tasks;
+        MetricsRegistry::Counter& executed_tasks;
+        MetricsRegistry::Counter& stale_tasks;
+        MetricsRegistry::Counter& cancelled_tasks;
+        MetricsRegistry::Counter& region_jumps;
+        MetricsRegistry::Counter& built_chunks;
+        MetricsRegistry::Counter& wasted_builds;
+        MetricsRegistry::Counter& compressed_chunks;
+        MetricsRegistry::Counter& uncompressed_bytes;
+        MetricsRegistry::Counter& compressed_bytes;
+        MetricsRegistry::Counter& compression_retries;
+        MetricsRegistry::Counter& decompress_failures;
+        MetricsRegistry::Counter& storage_loads;
+        MetricsRegistry::Counter& storage_hits;
+        MetricsRegistry::Counter& storage_load_skips;
+        MetricsRegistry::Counter& generation_cache_hits;
+        MetricsRegistry::Counter& generation_cache_misses;
+        MetricsRegistry::Counter& generation_cache_stores;
+        MetricsRegistry::Counter& lazy_evictions;
+        MetricsRegistry::Counter& loaded_evictions;
+        MetricsRegistry::Counter& evicted_bytes;
+        MetricsRegistry::Counter& pending_edits_added;
+        MetricsRegistry::Counter& pending_edits_applied;
+        MetricsRegistry::Counter& pending_edits_dropped;
+        MetricsRegistry::Counter& pending_edits_expired;
+
+        // amount of chunks in each state, finalized chunks are counted, until they are destroyed
+        MetricsRegistry::Gauge* chunk_states[CHUNK_FINALIZED + 1];
+        MetricsRegistry::Gauge& queued_chunk_tasks;
+        MetricsRegistry::Gauge& scheduled_chunk_updates;
+        MetricsRegistry::Gauge& lazy_chunk_memory;
+        MetricsRegistry::Gauge& chunk_memory;
+        MetricsRegistry::Gauge& chunk_memory_peak;
+        MetricsRegistry::Gauge& pending_edits;
+        MetricsRegistry::Gauge& pending_edit_chunks;
+
+        // pipeline stages and provider callbacks
+        MetricsRegistry::Histogram& stage_build;
+        MetricsRegistry::Histogram& stage_process;
+        MetricsRegistry::Histogram& stage_load;
+        MetricsRegistry::Histogram& stage_store;
+        MetricsRegistry::Histogram& stage_unload;
+        MetricsRegistry::Histogram& provider_create_chunk;
+        MetricsRegistry::Histogram& provider_build_chunk;
+        MetricsRegistry::Histogram& provider_process_chunk;
+        MetricsRegistry::Histogram& lazy_chunk_decompress;
+        MetricsRegistry::Histogram& generation_cache_load;
+        MetricsRegistry::Histogram& generation_cache_store;
+
+        explicit ChunkMetrics(MetricsRegistry& metrics);
+    };
+
     Unique<ChunkProvider> m_provider;
     Unique<ChunkStorage> m_storage;
+    // set only if generation cache is enabled and provider has generation identity
+    Shared<ChunkGenerationCache> m_generation_cache;
+    ChunkProvider::GenerationIdentity m_generation_identity;
 
     ChunkSourceState m_state;
     std::vector<ChunkSourceListener*> m_listeners;
+    MetricsRegistry m_metrics;
+    ChunkMetrics m_chunk_metrics;
+    u64 m_last_metrics_log;
+    // chunks, changed since previous tick, delivered to listeners in bulk on tick
+    std::mutex m_changed_chunks_mutex;
+    flat_hash_set<ChunkRef> m_changed_chunks;
     Settings m_settings;
 
-    std::mutex m_chunks_mutex;
-    flat_hash_map<ChunkPosition, Unique<Chunk>> m_chunks;
-    threading::BlockingQueue<ChunkRef> m_updates_queue;
-
-    threading::PriorityQueue<ChunkTask, 1024> m_chunk_task_queue;
-    threading::ThreadPoolExecutor<ChunkTask> m_chunk_task_executor;
+    // chunk map is split into 64 shards, each with its own lock, so accessing chunks from different threads rarely collides,
+    // shards are locked by chunk source instead of the map itself, so batched accesses lock each shard once
+    static const i32 CHUNK_MAP_SHARD_BITS = 6;
+    using ChunkMap = phmap::parallel_flat_hash_map<ChunkPosition, Unique<Chunk>,
+            phmap::priv::hash_default_hash<ChunkPosition>, phmap::priv::hash_default_eq<ChunkPosition>,
+            phmap::priv::Allocator<phmap::priv::Pair<const ChunkPosition, Unique<Chunk>>>, CHUNK_MAP_SHARD_BITS, phmap::NullMutex>;
+    ChunkMap m_chunks;
+    std::mutex m_chunk_map_shards[1 << CHUNK_MAP_SHARD_BITS];
+    // all chunks of the map, chunk references with handles are resolved here, map is used only to look up positions
+    ChunkSlotMap m_chunk_slots;
+    // edits for chunks, that are not built yet or were built, before edits were added, they are applied by the chunk itself
+    ChunkPendingEdits m_pending_edits;
+    threading::UniqueBlockingQueue<ChunkRef> m_edited_chunks;
+    // unloaded chunks are still locked by the unloading thread, so they are destroyed on the next tick (ticking thread only)
+    std::vector<Unique<Chunk>> m_finalized_chunks;
+    // each chunk in the map, except unloaded ones, has its update scheduled at the time, when its state can change,
+    // fetching chunk does not reschedule it, instead update reschedules itself, if chunk was fetched since
+    std::mutex m_chunk_updates_mutex;
+    TimerWheel<ChunkRef> m_chunk_updates;
+
+    // at most one task per chunk position is queued, repeated requests update it and raise its priority,
+    // neighbouring chunks are queued to the same worker
+    threading::WorkStealingPool<ChunkTaskKey, ChunkTask, 1024> m_chunk_task_pool;
+    // incremented on loading region jumps, to invalidate all tasks, that were queued before
+    std::atomic<u64> m_chunk_task_epoch = 0;
+
+    // if provider requires neighbours for processing, built chunks wait for their neighbours to be built,
+    // each pending neighbour keeps set of waiting chunks, which are notified, when it is built
+    bool m_neighbor_processing = false;
+    std::mutex m_processing_mutex;
+    flat_hash_map<ChunkPosition, ChunkProcessingDependency> m_processing_waiting;
+    flat_hash_map<ChunkPosition, flat_hash_set<ChunkPosition>> m_processing_dependents;
 
     std::mutex m_loaded_regions_mutex;
     std::vector<Shared<LoadingRegion>> m_loaded_regions;
+    // immutable snapshot, replaced on each region change, so loading levels are read without locking regions mutex
+    Shared<const LoadingLevelGrid> m_loading_level_grid;
+
+    std::atomic<i64> m_lazy_chunk_memory = 0;
+    // total memory of chunk buffers, each chunk is accounted, when its buffer can change: on pipeline stages and updates
+    std::atomic<i64> m_chunk_memory = 0;
+    std::atomic<i64> m_chunk_memory_peak = 0;
+    u64 m_last_memory_budget_check = 0;
+    u64 m_last_pending_edit_expiry = 0;
+    // created only if lazy chunk compression is enabled, declared last to be destroyed before everything else
+    Unique<threading::WorkerThread> m_lazy_compression_thread;
 
 public:
     ChunkSource(Unique<ChunkProvider> provider,
@@ -131,44 +404,42 @@ public:
     void setState(ChunkSourceState state);
     void addListener(ChunkSourceListener* listener);
     void removeListener(ChunkSourceListener* listener);
+    LazyChunkCompressionStats getLazyCompressionStats();
+    MemoryBudgetStats getMemoryBudgetStats();
+    ChunkTaskStats getChunkTaskStats();
+    MetricsRegistry& getMetrics();
+    MetricsRegistry::Snapshot getMetricsSnapshot();
 
     void onTick();
 
     // access and lock chunk according to given policy, on success, acquire will be called, otherwise - fallback, will return true on success
     template<ChunkAccessPolicy policy, typename AcquireFunc, typename FallbackFunc>
     inline bool accessChunk(const ChunkRef& ref, AcquireFunc acquire, FallbackFunc fallback) {
-        ThreadLock map_lock(m_chunks_mutex);
-        if (auto it = m_chunks.find(ref.position()); it != m_chunks.end()) {
-            Chunk* chunk = it->second.get();
-            if constexpr(policy == chunk_access_policy_strong) {
-                ThreadLock chunk_lock(chunk->getLock());
-                map_lock.unlock();
-                acquire(*chunk);
-                chunk_lock.unlock();
-                return true;
-            } else if constexpr(policy == chunk_access_policy_weak) {
-                if (chunk->tryLock()) {
-                    map_lock.unlock();
-                    acquire(*chunk);
-                    chunk->unlock();
-                    return true;
-                } else {
-                    map_lock.unlock();
-                }
-            } else if constexpr(policy == chunk_access_policy_map_only) {
-                acquire(*chunk);
-                map_lock.unlock();
-                return true;
-            } else if constexpr(policy == chunk_access_policy_no_lock) {
-                map_lock.unlock();
-                acquire(*chunk);
-                return true;
+        Chunk* chunk = nullptr;
+        bool exists = false;
+
+        // lambda is called with the chunk slot or the shard of chunk map locked
+        auto acquire_found = [&] (Chunk& found) {
+            exists = true;
+            chunk = lockFoundChunk<policy>(found, acquire);
+        };
+
+        // handle is resolved without hashing, if its chunk was removed, another chunk could be created at the same position
+        if (!ref.handle().valid() || !m_chunk_slots.access(ref.handle(), acquire_found)) {
+            size_t hash = m_chunks.hash(ref.position());
+            ThreadLock shard_lock(getChunkMapShard(hash));
+            auto it = m_chunks.find(ref.position(), hash);
+            if (it != m_chunks.end() && it->second) {
+                acquire_found(*it->second);
             }
-            fallback(true);
-        } else {
-            fallback(false);
         }
-        return false;
+
+        if (chunk == nullptr) {
+            fallback(exists);
+            return false;
+        }
+        acquireLockedChunk<policy>(*chunk, acquire);
+        return true;
     }
 
     template<ChunkAccessPolicy policy, typename AcquireFunc>
@@ -176,22 +447,111 @@ public:
         return accessChunk<policy>(ref, acquire, [] (bool) {});
     }
 
+    // accesses chunks of all refs according to given policy, acquire(chunk, index) is called for each acquired chunk and
+    // fallback(exists, index) for each other ref, returns amount of acquired chunks. Refs with handles are resolved by their
+    // slots, other refs are grouped by map shards, each shard is locked once for its group and its chunks are acquired,
+    // after it is released, so chunks are always acquired in the same order for the same refs.
+    template<ChunkAccessPolicy policy, typename AcquireFunc, typename FallbackFunc>
+    i32 accessChunks(const ChunkRef* refs, i32 count, AcquireFunc acquire, FallbackFunc fallback) {
+        static const i32 SHARD_COUNT = 1 << CHUNK_MAP_SHARD_BITS;
+        struct Entry {
+            i32 index;
+            size_t hash;
+            Chunk* chunk;
+            bool exists;
+        };
+
+        i32 acquired = 0;
+        std::vector<Entry> entries;
+        std::vector<i32> entry_shards;
+        i32 shard_offsets[SHARD_COUNT + 1] = {};
+        for (i32 i = 0; i < count; i++) {
+            const ChunkRef& ref = refs[i];
+            Chunk* chunk = nullptr;
+            bool exists = false;
+            auto acquire_indexed = [&] (Chunk& found) { acquire(found, i); };
+            if (ref.handle().valid() && m_chunk_slots.access(ref.handle(), [&] (Chunk& found) {
+                exists = true;
+                chunk = lockFoundChunk<policy>(found, acquire_indexed);
+            })) {
+                if (chunk != nullptr) {
+                    acquireLockedChunk<policy>(*chunk, acquire_indexed);
+                    acquired++;
+                } else {
+                    fallback(exists, i);
+                }
+                continue;
+            }
+            size_t hash = m_chunks.hash(ref.position());
+            i32 shard = i32(ChunkMap::subidx(hash));
+            entries.push_back({ i, hash, nullptr, false });
+            entry_shards.push_back(shard);
+            shard_offsets[shard + 1]++;
+        }
+        if (entries.empty()) {
+            return acquired;
+        }
+
+        // entries are ordered by shard with counting sort, keeping order of refs inside each shard
+        for (i32 shard = 0; shard < SHARD_COUNT; shard++) {
+            shard_offsets[shard + 1] += shard_offsets[shard];
+        }
+        std::vector<Entry> ordered(entries.size());
+        {
+            i32 positions[SHARD_COUNT];
+            std::copy(shard_offsets, shard_offsets + SHARD_COUNT, positions);
+            for (size_t i = 0; i < entries.size(); i++) {
+                ordered[positions[entry_shards[i]]++] = entries[i];
+            }
+        }
+
+        for (i32 shard = 0; shard < SHARD_COUNT; shard++) {
+            Entry* begin = ordered.data() + shard_offsets[shard];
+            Entry* end = ordered.data() + shard_offsets[shard + 1];
+            if (begin == end) {
+                continue;
+            }
+            {
+                ThreadLock shard_lock(m_chunk_map_shards[shard]);
+                for (Entry* entry = begin; entry != end; entry++) {
+                    auto it = m_chunks.find(refs[entry->index].position(), entry->hash);
+                    if (it != m_chunks.end() && it->second) {
+                        auto acquire_indexed = [&] (Chunk& found) { acquire(found, entry->index); };
+                        entry->exists = true;
+                        entry->chunk = lockFoundChunk<policy>(*it->second, acquire_indexed);
+                    }
+                }
+            }
+            for (Entry* entry = begin; entry != end; entry++) {
+                if (entry->chunk != nullptr) {
+                    auto acquire_indexed = [&] (Chunk& found) { acquire(found, entry->index); };
+                    acquireLockedChunk<policy>(*entry->chunk, acquire_indexed);
+                    acquired++;
+                } else {
+                    fallback(entry->exists, entry->index);
+                }
+            }
+        }
+        return acquired;
+    }
+
+    template<ChunkAccessPolicy policy, typename AcquireFunc, typename FallbackFunc>
+    inline i32 accessChunks(const std::vector<ChunkRef>& refs, AcquireFunc acquire, FallbackFunc fallback) {
+        return accessChunks<policy>(refs.data(), i32(refs.size()), acquire, fallback);
+    }
+
+    template<ChunkAccessPolicy policy, typename AcquireFunc>
+    inline i32 accessChunks(const std::vector<ChunkRef>& refs, AcquireFunc acquire) {
+        return accessChunks<policy>(refs.data(), i32(refs.size()), acquire, [] (bool, i32) {});
+    }
+
     template<typename AcquireFunc, typename FallbackFunc>
     bool fetchChunkAt(ChunkPosition position, i64 priority, AcquireFunc acquire, FallbackFunc fallback) {
         return accessChunk<chunk_access_policy_weak>(ChunkRef(position), [&](Chunk& chunk) {
-            chunk.fetch();
-            auto chunk_state = chunk.getState();
-            if (chunk_state == CHUNK_LOADED) {
-            } else if (chunk_state == CHUNK_LAZY) {
-                tryLoadLazyChunk(chunk);
-            } else {
-                m_chunk_task_queue.push({ position, TASK_LOAD, priority });
-            }
+            fetchChunk(chunk, priority);
             acquire(chunk);
         }, [&] (bool exists) {
-            if (m_provider->canFetchChunk(*this, position)) {
-                m_chunk_task_queue.push({ position, TASK_CREATE, priority });
-            }
+            fetchMissingChunk(position, priority);
             fallback(exists);
         });
     }
@@ -201,27 +561,138 @@ public:
         return fetchChunkAt(position, priority, acquire, [] (bool) {});
     }
 
+    // batched fetchChunkAt, acquire(chunk, index) and fallback(exists, index) are called like in accessChunks
+    template<typename AcquireFunc, typename FallbackFunc>
+    i32 fetchChunksAt(const ChunkFetch* fetches, i32 count, AcquireFunc acquire, FallbackFunc fallback) {
+        std::vector<ChunkRef> refs;
+        refs.reserve(count);
+        for (i32 i = 0; i < count; i++) {
+            refs.emplace_back(fetches[i].position);
+        }
+        return accessChunks<chunk_access_policy_weak>(refs.data(), count, [&] (Chunk& chunk, i32 index) {
+            fetchChunk(chunk, fetches[index].priority);
+            acquire(chunk, index);
+        }, [&] (bool exists, i32 index) {
+            fetchMissingChunk(fetches[index].position, fetches[index].priority);
+            fallback(exists, index);
+        });
+    }
+
+    template<typename AcquireFunc>
+    inline i32 fetchChunksAt(const std::vector<ChunkFetch>& fetches, AcquireFunc acquire) {
+        return fetchChunksAt(fetches.data(), i32(fetches.size()), acquire, [] (bool, i32) {});
+    }
+
+    // buffers voxel edits for the chunk at position, can be called from any thread, including provider callbacks for
+    // other chunks, target chunk is not locked or created, edits are applied, when it is built or loaded from storage,
+    // or on its next update, if it is already built, edits for chunks, that cannot be fetched, are dropped,
+    // every dropped edit is counted in metrics and logged as a warning
+    void addPendingEdits(ChunkPosition position, const ChunkPendingEdits::Edit* edits, i32 count);
+    inline void addPendingEdits(ChunkPosition position, const std::vector<ChunkPendingEdits::Edit>& edits) {
+        addPendingEdits(position, edits.data(), i32(edits.size()));
+    }
+    // queues writing of all pending edits of chunks, that are not in memory, into storage, without waiting for timeout,
+    // edits of chunks, that are not stored, are dropped, used to persist edits before the chunk source is destroyed
+    void storePendingEdits();
+
     const Shared<LoadingRegion>& addLoadingRegion(math::Vec3i position, i32 loading_level);
     void removeLoadingRegion(const Shared<LoadingRegion>& loading_region);
     i32 getLoadingLevelForPosition(ChunkPosition position);
 
 private:
-    void runChunkTask(ChunkTask task);
+    // first part of chunk access, called with the chunk slot or the shard of chunk map locked, returns chunk to acquire or nullptr
+    template<ChunkAccessPolicy policy, typename AcquireFunc>
+    static inline Chunk* lockFoundChunk(Chunk& found, AcquireFunc& acquire) {
+        if constexpr(policy == chunk_access_policy_strong) {
+            found.pin();
+        } else if constexpr(policy == chunk_access_policy_weak) {
+            if (!found.tryLock()) {
+                return nullptr;
+            }
+        } else if constexpr(policy == chunk_access_policy_map_only) {
+            acquire(found);
+        }
+        return &found;
+    }
 
-    void tryCreateNewChunk(ChunkPosition position);
-    void tryLoadLazyChunk(Chunk& chunk);
-    void handleChunkLoading(Chunk& chunk);
-    void handleLazyChunk(Chunk& chunk);
-    void startUpdatingChunk(Chunk& chunk);
-    bool updateChunk(ChunkRef ref);
+    // second part of chunk access, called for chunk, returned by lockFoundChunk, after the slot or the shard is unlocked
+    template<ChunkAccessPolicy policy, typename AcquireFunc>
+    static inline void acquireLockedChunk(Chunk& chunk, AcquireFunc& acquire) {
+        if constexpr(policy == chunk_access_policy_strong) {
+            {
+                ThreadLock chunk_lock(chunk.getLock());
+                acquire(chunk);
+            }
+            chunk.unpin();
+        } else if constexpr(policy == chunk_access_policy_weak) {
+            acquire(chunk);
+            chunk.unlock();
+        } else if constexpr(policy == chunk_access_policy_no_lock) {
+            acquire(chunk);
+        }
+    }
+
+    inline std::mutex& getChunkMapShard(size_t hash) {
+        return m_chunk_map_shards[ChunkMap::subidx(hash)];
+    }
+
+    // called for fetched chunk with the chunk locked and for fetched position, that has no chunk
+    void fetchChunk(Chunk& chunk, i64 priority);
+    void fetchMissingChunk(ChunkPosition position, i64 priority);
+
+    void queueChunkTask(ChunkPosition position, ChunkTaskType type, i64 priority);
+    void runChunkTask(ChunkTask task);
+    bool isChunkTaskStale(const ChunkTask& task);
+    void cancelAllChunkTasks();
+    // called for tasks, that are dropped without running, and for build tasks, that could not build their chunk
+    void dropChunkTask(const ChunkTask& task);
+
+    void setChunkState(Chunk& chunk, ChunkState state);
+    void updateMetricGauges();
+    // returns true, if chunk was created by this call
+    bool tryCreateNewChunk(ChunkPosition position);
+    void tryLoadLazyChunk(Chunk& chunk, i64 priority);
+    void handleChunkLoading(Chunk& chunk, i64 priority);
+    void handleLazyChunk(Chunk& chunk, i64 priority);
+    void startLazyChunk(Chunk& chunk);
+    void queueLazyChunkCompression(ChunkRef ref);
+    // returns false, if buffer failed to decompress, in this case chunk is reset to pending state
+    bool releaseLazyChunk(Chunk& chunk);
+    void compressLazyChunk(ChunkRef ref);
+    void accountChunkMemory(Chunk& chunk);
+    void addChunkMemory(i64 delta);
+    void enforceMemoryBudget();
+    void scheduleChunkUpdate(ChunkRef ref, u64 time);
+    void updateChunk(ChunkRef ref);
 
     void runChunkBuild(Chunk& chunk);
     void runChunkProcessing(Chunk& chunk);
+    void scheduleChunkProcessing(ChunkPosition position, i64 priority);
+    void notifyChunkBuilt(ChunkPosition position);
+    void runChunkProcessingWithNeighbors(ChunkPosition position, i64 priority);
+    // storage is asked, if it may contain chunk, before loading it
+    bool tryLoadStoredChunk(Chunk& chunk);
+    // generation cache is checked after storage, generated chunks are stored right after processing
+    bool tryLoadGeneratedChunk(Chunk& chunk);
+    void storeGeneratedChunk(Chunk& chunk);
+    // existing chunks, that received pending edits, apply them on the ticking thread
+    void updateEditedChunks();
+    // stores or drops pending edits of chunks, that were not created within pending edit timeout
+    void expirePendingEdits();
+    // loads chunk from storage, applies its pending edits and stores it again, chunk must not be in memory,
+    // edits of chunk, that is not stored, are dropped
+    void runPendingEditsStore(ChunkPosition position);
+    void reportDroppedEdits(MetricsRegistry::Counter& counter, ChunkPosition position, i64 count, const char* reason);
+    // applies pending edits of locked chunk, its buffer must not be compressed, returns true, if there were any
+    bool applyPendingEdits(Chunk& chunk);
     void runChunkLoad(Chunk& chunk);
-    void runChunkUnload(Chunk& chunk);
+    bool runChunkUnload(Chunk& chunk);
+
+    void updateLoadingLevelGrid(const LoadingLevelGrid::Region* removed, const LoadingLevelGrid::Region* added);
 
     void fireEventTick();
     void fireEventChunkUpdated(Chunk& chunk);
+    void fireEventChunksUpdated();
 };
 
 } // voxel
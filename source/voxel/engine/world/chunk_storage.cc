@@ -14,4 +14,8 @@ bool ChunkStorage::tryLoadChunk(ChunkSource& chunk_source, Chunk&) {
     return false;
 }
 
+bool ChunkStorage::mayContainChunk(ChunkSource& chunk_source, ChunkPosition position) {
+    return true;
+}
+
 }
\ No newline at end of file
@@ -17,6 +17,10 @@ public:
 
     // attempts to load chunk from storage, returns true, if chunk was loaded and should skip build and processing stages
     virtual bool tryLoadChunk(ChunkSource& chunk_source, Chunk&);
+
+    // returns false, only if storage definitely does not contain chunk at the position, in this case tryLoadChunk is
+    // not called for it, storages, that do I/O on load, should answer from their in-memory index of stored chunks
+    virtual bool mayContainChunk(ChunkSource& chunk_source, ChunkPosition position);
 };
 
 } // voxel
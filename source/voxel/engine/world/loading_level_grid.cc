@@ -0,0 +1,103 @@
+#include "loading_level_grid.h"
+
+#include <cmath>
+#include <algorithm>
+
+
+namespace voxel {
+
+i32 LoadingLevelGrid::Region::getDistance(math::Vec3i delta) const {
+    if (shape == REGION_SHAPE_SPHERE) {
+        f32 dy = f32(delta.y) * vertical_scale;
+        return i32(ceil(sqrt(f32(delta.x * delta.x + delta.z * delta.z) + dy * dy)));
+    }
+    i32 dy = vertical_scale == 1.0f ? abs(delta.y) : i32(ceil(f32(abs(delta.y)) * vertical_scale));
+    return std::max(abs(delta.x), std::max(dy, abs(delta.z)));
+}
+
+i32 LoadingLevelGrid::Region::getLoadingLevel(ChunkPosition chunk_position) const {
+    math::Vec3i delta = math::Vec3i(chunk_position.x, chunk_position.y, chunk_position.z) - position;
+    i32 distance = getDistance(delta);
+    if (view_falloff <= 0 || distance == 0) {
+        return level - distance;
+    }
+
+    // falloff grows linearly with cosine from the edge of the view cone to the opposite direction
+    f32 view_dot = math::dot(math::Vec3f(f32(delta.x), f32(delta.y), f32(delta.z)), view_direction);
+    f32 cos_angle = view_dot / math::len(delta);
+    if (cos_angle >= view_cos) {
+        return level - distance;
+    }
+    f32 falloff = f32(view_falloff) * (view_cos - cos_angle) / (view_cos + 1.0f);
+    return level - distance - i32(ceil(falloff));
+}
+
+i32 LoadingLevelGrid::getLoadingLevel(ChunkPosition position) const {
+    auto it = m_cells.find(ChunkPosition(position.x >> CELL_SIZE_BITS, position.y >> CELL_SIZE_BITS, position.z >> CELL_SIZE_BITS));
+    if (it == m_cells.end()) {
+        return 0;
+    }
+
+    i32 level = 0;
+    for (auto& region : it->second->regions) {
+        level = std::max(level, region.getLoadingLevel(position));
+    }
+    return level;
+}
+
+bool LoadingLevelGrid::isEmpty() const {
+    return m_cells.empty();
+}
+
+template<typename Func>
+void LoadingLevelGrid::forEachCell(const Region& region, Func func) {
+    // region has positive level only at distance less, than its loading level, view falloff only lowers it
+    i32 radius = region.level - 1;
+    if (radius < 0) {
+        return;
+    }
+    // vertical extent is conservative, distance is rounded up after scaling
+    i32 vertical_radius = region.vertical_scale == 1.0f ? radius : i32(f32(radius) / region.vertical_scale) + 1;
+    math::Vec3i from = region.position - math::Vec3i(radius, vertical_radius, radius);
+    math::Vec3i to = region.position + math::Vec3i(radius, vertical_radius, radius);
+    for (i32 x = from.x >> CELL_SIZE_BITS; x <= to.x >> CELL_SIZE_BITS; x++) {
+        for (i32 y = from.y >> CELL_SIZE_BITS; y <= to.y >> CELL_SIZE_BITS; y++) {
+            for (i32 z = from.z >> CELL_SIZE_BITS; z <= to.z >> CELL_SIZE_BITS; z++) {
+                func(ChunkPosition(x, y, z));
+            }
+        }
+    }
+}
+
+void LoadingLevelGrid::addRegion(const Region& region) {
+    forEachCell(region, [&] (const ChunkPosition& cell_position) {
+        auto& cell = m_cells[cell_position];
+        // cell could be shared with other grids, so it is copied
+        Shared<Cell> new_cell = cell ? CreateShared<Cell>(*cell) : CreateShared<Cell>();
+        new_cell->regions.emplace_back(region);
+        cell = new_cell;
+    });
+}
+
+void LoadingLevelGrid::removeRegion(const Region& region) {
+    forEachCell(region, [&] (const ChunkPosition& cell_position) {
+        auto it = m_cells.find(cell_position);
+        if (it == m_cells.end()) {
+            return;
+        }
+
+        Shared<Cell> new_cell = CreateShared<Cell>(*it->second);
+        auto& regions = new_cell->regions;
+        regions.erase(std::remove_if(regions.begin(), regions.end(), [&] (const Region& other) {
+            return other.id == region.id;
+        }), regions.end());
+
+        if (regions.empty()) {
+            m_cells.erase(it);
+        } else {
+            it->second = new_cell;
+        }
+    });
+}
+
+} // voxel
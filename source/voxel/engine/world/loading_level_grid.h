@@ -0,0 +1,75 @@
+#ifndef VOXEL_ENGINE_LOADING_LEVEL_GRID_H
+#define VOXEL_ENGINE_LOADING_LEVEL_GRID_H
+
+#include <vector>
+#include "voxel/common/base.h"
+#include "voxel/common/math/vec.h"
+#include "voxel/engine/shared/chunk_position.h"
+
+
+namespace voxel {
+
+// distance metric of a loading region, level of the region falls by 1 per chunk of distance
+enum LoadingRegionShape {
+    // max of distances along axes
+    REGION_SHAPE_CUBE,
+    // euclidean distance, rounded up, loads about half as many chunks, as the cube of the same radius
+    REGION_SHAPE_SPHERE
+};
+
+/*
+ * Sparse grid of loading levels. Space is split into cells of 2^CELL_SIZE_BITS chunks, each cell keeps
+ * only loading regions, that reach it, so level of a position is calculated from a few nearby regions.
+ * Cells are immutable and shared between copies of the grid, so modified copy can be built incrementally,
+ * while the old one is still read from other threads. Level of a region falls by 1 per chunk of distance in
+ * the metric of its shape, and regions with a view cone lose up to a few more levels behind it.
+ */
+class LoadingLevelGrid {
+public:
+    static const i32 CELL_SIZE_BITS = 4;
+
+    struct Region {
+        // unique region identifier, used to remove it
+        const void* id;
+        math::Vec3i position;
+        i32 level;
+
+        LoadingRegionShape shape = REGION_SHAPE_CUBE;
+        // vertical distances are multiplied by this, values above 1 make region flatter, than it is wide
+        f32 vertical_scale = 1.0f;
+
+        // normalized view direction, zero direction makes level the same in all directions, otherwise level
+        // outside of the view cone is lowered by up to view_falloff, reached directly behind the region
+        math::Vec3f view_direction = math::Vec3f(0.0f);
+        // cosine of the half angle of the view cone
+        f32 view_cos = 0.0f;
+        i32 view_falloff = 0;
+
+        i32 getLoadingLevel(ChunkPosition position) const;
+        i32 getDistance(math::Vec3i delta) const;
+    };
+
+private:
+    struct Cell {
+        std::vector<Region> regions;
+    };
+
+    flat_hash_map<ChunkPosition, Shared<const Cell>> m_cells;
+
+public:
+    i32 getLoadingLevel(ChunkPosition position) const;
+    // true, if no region reaches any chunk
+    bool isEmpty() const;
+
+    // region must be removed with the same position and level, as it was added
+    void addRegion(const Region& region);
+    void removeRegion(const Region& region);
+
+private:
+    template<typename Func>
+    void forEachCell(const Region& region, Func func);
+};
+
+} // voxel
+
+#endif //VOXEL_ENGINE_LOADING_LEVEL_GRID_H
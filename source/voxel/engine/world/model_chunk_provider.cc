@@ -0,0 +1,200 @@
+#include "model_chunk_provider.h"
+
+#include <algorithm>
+#include "voxel/engine/world/chunk.h"
+
+
+namespace voxel {
+
+static inline i32 floorDiv(i32 a, i32 b) {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+static inline math::Vec3i minVec(const math::Vec3i& a, const math::Vec3i& b) {
+    return math::Vec3i(std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z));
+}
+
+static inline math::Vec3i maxVec(const math::Vec3i& a, const math::Vec3i& b) {
+    return math::Vec3i(std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z));
+}
+
+static inline bool isEmptyBox(const math::Vec3i& min, const math::Vec3i& max) {
+    return min.x >= max.x || min.y >= max.y || min.z >= max.z;
+}
+
+ModelChunkProvider::ModelChunkProvider(Settings settings) : m_settings(settings) {
+}
+
+i32 ModelChunkProvider::addModel(const ModelInstance& instance) {
+    Shared<PlacedInstance> placed = CreateShared<PlacedInstance>();
+    placed->instance = instance;
+    placed->instance.scale = std::max(instance.scale, 1);
+    placed->inverse_rotation = instance.rotation.inverse();
+    placed->scale_bits = -1;
+    for (i32 bits = 0; bits < m_settings.chunk_scale; bits++) {
+        if ((1 << bits) == placed->instance.scale) {
+            placed->scale_bits = bits;
+        }
+    }
+
+    // rotated model is shifted, so its min corner is at zero
+    math::Vec3i size = instance.model->getSize();
+    math::Vec3i rotated_min(0x7fffffff);
+    math::Vec3i rotated_max(-0x7fffffff);
+    for (i32 corner = 0; corner < 8; corner++) {
+        math::Vec3i v(corner & 1 ? size.x - 1 : 0, corner & 2 ? size.y - 1 : 0, corner & 4 ? size.z - 1 : 0);
+        math::Vec3i r = instance.rotation.apply(v);
+        rotated_min = minVec(rotated_min, r);
+        rotated_max = maxVec(rotated_max, r);
+    }
+    placed->rotated_offset = rotated_min;
+    placed->min = instance.position;
+    placed->max = instance.position + (rotated_max - rotated_min + math::Vec3i(1)) * placed->instance.scale;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    placed->id = m_next_id++;
+    m_instances.emplace(placed->id, placed);
+    forEachChunk(*placed, [&] (const ChunkPosition& position) -> void {
+        m_chunk_index[position].emplace_back(placed);
+    });
+    return placed->id;
+}
+
+bool ModelChunkProvider::removeModel(i32 id) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto it = m_instances.find(id);
+    if (it == m_instances.end()) {
+        return false;
+    }
+    Shared<const PlacedInstance> placed = it->second;
+    m_instances.erase(it);
+    forEachChunk(*placed, [&] (const ChunkPosition& position) -> void {
+        auto chunk_it = m_chunk_index.find(position);
+        if (chunk_it != m_chunk_index.end()) {
+            auto& instances = chunk_it->second;
+            instances.erase(std::remove(instances.begin(), instances.end(), placed), instances.end());
+            if (instances.empty()) {
+                m_chunk_index.erase(chunk_it);
+            }
+        }
+    });
+    return true;
+}
+
+i32 ModelChunkProvider::getModelCount() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return i32(m_instances.size());
+}
+
+bool ModelChunkProvider::canFetchChunk(ChunkSource& chunk_source, ChunkPosition position) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_chunk_index.find(position) != m_chunk_index.end();
+}
+
+Unique<Chunk> ModelChunkProvider::createChunk(ChunkSource& chunk_source, ChunkPosition position) {
+    return CreateUnique<Chunk>(position);
+}
+
+bool ModelChunkProvider::buildChunk(ChunkSource& chunk_source, Chunk& chunk) {
+    std::vector<Shared<const PlacedInstance>> instances = getInstancesForChunk(chunk.getPosition());
+    if (instances.empty()) {
+        return true;
+    }
+
+    const ChunkPosition& position = chunk.getPosition();
+    i32 chunk_size = 1 << m_settings.chunk_scale;
+    math::Vec3i chunk_min(position.x * chunk_size, position.y * chunk_size, position.z * chunk_size);
+    math::Vec3i chunk_max = chunk_min + math::Vec3i(chunk_size);
+
+    // instance bounds, clipped by the chunk
+    std::vector<std::pair<math::Vec3i, math::Vec3i>> bounds;
+    for (auto& placed : instances) {
+        bounds.emplace_back(maxVec(placed->min, chunk_min), minVec(placed->max, chunk_max));
+    }
+
+    for (i32 i = 0; i < i32(instances.size()); i++) {
+        // setting voxel inside large cell splits it, so large cells are used only where instances do not overlap
+        bool allow_large_cells = true;
+        for (i32 j = 0; j < i32(instances.size()) && allow_large_cells; j++) {
+            if (i != j && !isEmptyBox(maxVec(bounds[i].first, bounds[j].first), minVec(bounds[i].second, bounds[j].second))) {
+                allow_large_cells = false;
+            }
+        }
+        emitInstance(chunk, *instances[i], bounds[i].first - chunk_min, bounds[i].second - chunk_min, allow_large_cells);
+    }
+    return true;
+}
+
+template<typename Func>
+void ModelChunkProvider::forEachChunk(const PlacedInstance& placed, Func func) {
+    i32 chunk_size = 1 << m_settings.chunk_scale;
+    math::Vec3i min(floorDiv(placed.min.x, chunk_size), floorDiv(placed.min.y, chunk_size), floorDiv(placed.min.z, chunk_size));
+    math::Vec3i max(floorDiv(placed.max.x - 1, chunk_size), floorDiv(placed.max.y - 1, chunk_size), floorDiv(placed.max.z - 1, chunk_size));
+    for (i32 x = min.x; x <= max.x; x++) {
+        for (i32 y = min.y; y <= max.y; y++) {
+            for (i32 z = min.z; z <= max.z; z++) {
+                func(ChunkPosition(x, y, z));
+            }
+        }
+    }
+}
+
+std::vector<Shared<const ModelChunkProvider::PlacedInstance>> ModelChunkProvider::getInstancesForChunk(ChunkPosition position) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto it = m_chunk_index.find(position);
+    if (it == m_chunk_index.end()) {
+        return {};
+    }
+    return it->second;
+}
+
+void ModelChunkProvider::emitInstance(Chunk& chunk, const PlacedInstance& placed, const math::Vec3i& min, const math::Vec3i& max, bool allow_large_cells) {
+    if (isEmptyBox(min, max)) {
+        return;
+    }
+
+    // min and max are relative to the chunk, cell range is in rotated model voxels
+    VoxelModel& model = *placed.instance.model;
+    i32 scale = placed.instance.scale;
+    const ChunkPosition& position = chunk.getPosition();
+    i32 chunk_size = 1 << m_settings.chunk_scale;
+    math::Vec3i origin = placed.min - math::Vec3i(position.x * chunk_size, position.y * chunk_size, position.z * chunk_size);
+    math::Vec3i cell_min(floorDiv(min.x - origin.x, scale), floorDiv(min.y - origin.y, scale), floorDiv(min.z - origin.z, scale));
+    math::Vec3i cell_max(floorDiv(max.x - origin.x - 1, scale), floorDiv(max.y - origin.y - 1, scale), floorDiv(max.z - origin.z - 1, scale));
+
+    for (i32 cx = cell_min.x; cx <= cell_max.x; cx++) {
+        for (i32 cy = cell_min.y; cy <= cell_max.y; cy++) {
+            for (i32 cz = cell_min.z; cz <= cell_max.z; cz++) {
+                math::Vec3i m = placed.inverse_rotation.apply(math::Vec3i(cx, cy, cz) + placed.rotated_offset);
+                Voxel voxel = model.getVoxel(m.x, m.y, m.z);
+                if (voxel.color == 0) {
+                    continue;
+                }
+
+                math::Vec3i voxel_min = origin + math::Vec3i(cx, cy, cz) * scale;
+                math::Vec3i voxel_max = voxel_min + math::Vec3i(scale);
+                if (allow_large_cells && placed.scale_bits >= 0 &&
+                        (voxel_min.x & (scale - 1)) == 0 && (voxel_min.y & (scale - 1)) == 0 && (voxel_min.z & (scale - 1)) == 0 &&
+                        voxel_min.x >= 0 && voxel_min.y >= 0 && voxel_min.z >= 0 &&
+                        voxel_max.x <= chunk_size && voxel_max.y <= chunk_size && voxel_max.z <= chunk_size) {
+                    // aligned power of two cube is a single octree cell
+                    u8 cell_scale = u8(m_settings.chunk_scale - placed.scale_bits);
+                    chunk.setVoxel({ cell_scale, u32(voxel_min.x >> placed.scale_bits), u32(voxel_min.y >> placed.scale_bits), u32(voxel_min.z >> placed.scale_bits) }, voxel);
+                    continue;
+                }
+
+                voxel_min = maxVec(voxel_min, min);
+                voxel_max = minVec(voxel_max, max);
+                for (i32 x = voxel_min.x; x < voxel_max.x; x++) {
+                    for (i32 y = voxel_min.y; y < voxel_max.y; y++) {
+                        for (i32 z = voxel_min.z; z < voxel_max.z; z++) {
+                            chunk.setVoxel({ m_settings.chunk_scale, u32(x), u32(y), u32(z) }, voxel);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+} // voxel
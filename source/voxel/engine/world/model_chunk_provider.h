@@ -0,0 +1,87 @@
+#ifndef VOXEL_ENGINE_MODEL_CHUNK_PROVIDER_H
+#define VOXEL_ENGINE_MODEL_CHUNK_PROVIDER_H
+
+#include <vector>
+#include <mutex>
+#include "voxel/common/base.h"
+#include "voxel/common/math/vec.h"
+#include "voxel/engine/shared/voxel_model.h"
+#include "voxel/engine/shared/voxel_rotation.h"
+#include "voxel/engine/world/chunk_provider.h"
+
+
+namespace voxel {
+
+/*
+ * Places any amount of voxel models into the world, each with its own position, scale and rotation.
+ * Models are indexed by chunks they overlap, so each chunk build only visits its own models, and big models
+ * are split between many chunks, which are built in parallel. Models, added later, overwrite earlier ones.
+ * Models, that are added or removed after chunks were built, affect only chunks, that are built after it.
+ */
+class ModelChunkProvider : public ChunkProvider {
+public:
+    struct Settings {
+        // chunk has 2^chunk_scale voxels along each axis
+        u8 chunk_scale = 5;
+    };
+
+    struct ModelInstance {
+        Shared<VoxelModel> model;
+
+        // position of the min corner of transformed model in world voxels
+        math::Vec3i position;
+
+        // each model voxel becomes a cube of scale^3 world voxels, power of two scales are emitted as larger octree cells
+        i32 scale = 1;
+
+        // rotation of the model, rotated model is placed with its min corner at position
+        VoxelRotation rotation = VoxelRotation::identity();
+    };
+
+private:
+    struct PlacedInstance {
+        i32 id;
+        ModelInstance instance;
+
+        // world voxel bounds of transformed model, max is exclusive
+        math::Vec3i min;
+        math::Vec3i max;
+
+        // model voxel = inverse_rotation * (rotated voxel + rotated_offset)
+        VoxelRotation inverse_rotation;
+        math::Vec3i rotated_offset;
+
+        // log2 of scale, if it is power of two, -1 otherwise
+        i32 scale_bits;
+    };
+
+    Settings m_settings;
+
+    std::mutex m_mutex;
+    i32 m_next_id = 0;
+    flat_hash_map<i32, Shared<const PlacedInstance>> m_instances;
+    // instances, overlapping each chunk, ordered by id
+    flat_hash_map<ChunkPosition, std::vector<Shared<const PlacedInstance>>> m_chunk_index;
+
+public:
+    ModelChunkProvider(Settings settings);
+
+    // adds model instance and returns its id
+    i32 addModel(const ModelInstance& instance);
+    bool removeModel(i32 id);
+    i32 getModelCount();
+
+    bool canFetchChunk(ChunkSource& chunk_source, ChunkPosition position) override;
+    Unique<Chunk> createChunk(ChunkSource& chunk_source, ChunkPosition position) override;
+    bool buildChunk(ChunkSource& chunk_source, Chunk& chunk) override;
+
+private:
+    template<typename Func>
+    void forEachChunk(const PlacedInstance& placed, Func func);
+    std::vector<Shared<const PlacedInstance>> getInstancesForChunk(ChunkPosition position);
+    void emitInstance(Chunk& chunk, const PlacedInstance& placed, const math::Vec3i& min, const math::Vec3i& max, bool allow_large_cells);
+};
+
+} // voxel
+
+#endif //VOXEL_ENGINE_MODEL_CHUNK_PROVIDER_H
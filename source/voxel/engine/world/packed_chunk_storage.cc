@@ -0,0 +1,287 @@
+#include "packed_chunk_storage.h"
+
+#include <cstring>
+#include <vector>
+#include <filesystem>
+#include "voxel/common/logger.h"
+#include "voxel/common/utils/time.h"
+#include "voxel/engine/world/chunk.h"
+
+
+namespace voxel {
+
+static const u32 RECORD_MAGIC = 0x52435856u; // VXCR
+static const u32 INDEX_FILE_MAGIC = 0x49435856u; // VXCI
+static const u32 INDEX_FILE_FORMAT = 1;
+
+struct RecordHeader {
+    u32 magic;
+    i32 x, y, z;
+    u32 payload_size;
+    u32 reserved;
+    u64 payload_checksum;
+};
+
+struct IndexFileHeader {
+    u32 magic;
+    u32 format;
+    u64 data_size;
+    u64 record_count;
+    u64 checksum;
+};
+
+struct IndexFileRecord {
+    i32 x, y, z;
+    u32 size;
+    u64 offset;
+};
+
+// FNV-1a
+static u64 hashBytes(const void* data, size_t size, u64 hash = 14695981039346656037ull) {
+    const byte* bytes = static_cast<const byte*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+PackedChunkStorage::PackedChunkStorage(const std::string& directory) :
+        m_directory(directory), m_data_path(directory + "/chunks.dat"), m_index_path(directory + "/chunks.idx") {
+    open();
+}
+
+PackedChunkStorage::~PackedChunkStorage() {
+    if (m_is_open) {
+        flush();
+    }
+}
+
+void PackedChunkStorage::open() {
+    std::error_code error;
+    std::filesystem::create_directories(m_directory, error);
+    if (!std::filesystem::exists(m_data_path, error)) {
+        std::ofstream create(m_data_path, std::ofstream::binary);
+    }
+    m_data_file.open(m_data_path, std::fstream::in | std::fstream::out | std::fstream::binary);
+    if (!m_data_file.is_open()) {
+        Logger().message(Logger::flag_error, "PackedChunkStorage", "failed to open %s", m_data_path.c_str());
+        return;
+    }
+    m_is_open = true;
+    m_data_size = std::filesystem::file_size(m_data_path, error);
+
+    // index could be saved before the last records were written, or be missing completely
+    u64 indexed_data_size = 0;
+    if (!loadIndex(indexed_data_size) || indexed_data_size > m_data_size) {
+        m_records.clear();
+        indexed_data_size = 0;
+    }
+    scanRecords(indexed_data_size);
+}
+
+bool PackedChunkStorage::loadIndex(u64& indexed_data_size) {
+    std::ifstream istream(m_index_path, std::ifstream::binary);
+    if (!istream.is_open()) {
+        return false;
+    }
+    IndexFileHeader header;
+    if (!istream.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+            header.magic != INDEX_FILE_MAGIC || header.format != INDEX_FILE_FORMAT) {
+        return false;
+    }
+    std::error_code error;
+    u64 file_size = std::filesystem::file_size(m_index_path, error);
+    if (error || header.record_count != (file_size - sizeof(header)) / sizeof(IndexFileRecord)) {
+        return false;
+    }
+    std::vector<IndexFileRecord> records(header.record_count);
+    if (!istream.read(reinterpret_cast<char*>(records.data()), std::streamsize(records.size() * sizeof(IndexFileRecord))) ||
+            hashBytes(records.data(), records.size() * sizeof(IndexFileRecord)) != header.checksum) {
+        return false;
+    }
+    for (auto& record : records) {
+        if (record.offset + sizeof(RecordHeader) + record.size > header.data_size) {
+            return false;
+        }
+        m_records.insert_or_assign(ChunkPosition(record.x, record.y, record.z), Record { record.offset, record.size });
+    }
+    indexed_data_size = header.data_size;
+    return true;
+}
+
+void PackedChunkStorage::scanRecords(u64 offset) {
+    std::vector<byte> payload;
+    while (offset < m_data_size) {
+        RecordHeader header;
+        bool is_valid = offset + sizeof(header) <= m_data_size;
+        if (is_valid) {
+            m_data_file.clear();
+            m_data_file.seekg(std::streamoff(offset));
+            is_valid = m_data_file.read(reinterpret_cast<char*>(&header), sizeof(header)) && header.magic == RECORD_MAGIC &&
+                    offset + sizeof(header) + header.payload_size <= m_data_size;
+        }
+        if (is_valid) {
+            payload.resize(header.payload_size);
+            is_valid = m_data_file.read(reinterpret_cast<char*>(payload.data()), std::streamsize(payload.size())) &&
+                    hashBytes(payload.data(), payload.size()) == header.payload_checksum;
+        }
+
+        // everything after the first invalid record was written after the crash or never completely written
+        if (!is_valid) {
+            m_truncated_bytes = i64(m_data_size - offset);
+            m_data_file.close();
+            std::error_code error;
+            std::filesystem::resize_file(m_data_path, offset, error);
+            m_data_file.open(m_data_path, std::fstream::in | std::fstream::out | std::fstream::binary);
+            m_data_size = offset;
+            Logger().message(Logger::flag_warning, "PackedChunkStorage", "truncated %lld bytes of incomplete record in %s",
+                             (long long) m_truncated_bytes, m_data_path.c_str());
+            break;
+        }
+        m_records.insert_or_assign(ChunkPosition(header.x, header.y, header.z), Record { offset, header.payload_size });
+        m_recovered_chunks++;
+        offset += sizeof(header) + header.payload_size;
+    }
+}
+
+bool PackedChunkStorage::saveIndex() {
+    // called with the file mutex locked, so records are consistent with the data size
+    std::vector<IndexFileRecord> records;
+    records.reserve(m_records.size());
+    m_records.for_each([&] (const auto& record) {
+        records.push_back({ record.first.x, record.first.y, record.first.z, record.second.size, record.second.offset });
+    });
+
+    IndexFileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = INDEX_FILE_MAGIC;
+    header.format = INDEX_FILE_FORMAT;
+    header.data_size = m_data_size;
+    header.record_count = records.size();
+    header.checksum = hashBytes(records.data(), records.size() * sizeof(IndexFileRecord));
+
+    std::error_code error;
+    std::filesystem::path index_path(m_index_path);
+    std::filesystem::path temp_path = index_path;
+    temp_path += ".tmp" + std::to_string(utils::getTimestampNanos());
+    {
+        std::ofstream ostream(temp_path, std::ofstream::binary | std::ofstream::trunc);
+        if (!ostream.write(reinterpret_cast<const char*>(&header), sizeof(header)) ||
+                !ostream.write(reinterpret_cast<const char*>(records.data()), std::streamsize(records.size() * sizeof(IndexFileRecord)))) {
+            ostream.close();
+            std::filesystem::remove(temp_path, error);
+            return false;
+        }
+    }
+    std::filesystem::rename(temp_path, index_path, error);
+    if (error) {
+        std::filesystem::remove(temp_path, error);
+        return false;
+    }
+    return true;
+}
+
+bool PackedChunkStorage::tryStoreChunk(ChunkSource& chunk_source, Chunk& chunk) {
+    if (!m_is_open) {
+        return false;
+    }
+    // record is prepared before taking the file mutex
+    std::vector<byte> data(sizeof(RecordHeader));
+    chunk.writeBuffer(data);
+    RecordHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = RECORD_MAGIC;
+    header.x = chunk.getPosition().x;
+    header.y = chunk.getPosition().y;
+    header.z = chunk.getPosition().z;
+    header.payload_size = u32(data.size() - sizeof(header));
+    header.payload_checksum = hashBytes(data.data() + sizeof(header), header.payload_size);
+    memcpy(data.data(), &header, sizeof(header));
+
+    std::unique_lock<std::mutex> lock(m_file_mutex);
+    m_data_file.clear();
+    m_data_file.seekp(std::streamoff(m_data_size));
+    if (!m_data_file.write(reinterpret_cast<const char*>(data.data()), std::streamsize(data.size()))) {
+        // chunk stays in memory and is stored again later
+        m_data_file.clear();
+        return false;
+    }
+    m_records.insert_or_assign(chunk.getPosition(), Record { m_data_size, header.payload_size });
+    m_data_size += data.size();
+    m_stored_chunks++;
+    m_stored_bytes += i64(data.size());
+    return true;
+}
+
+bool PackedChunkStorage::tryLoadChunk(ChunkSource& chunk_source, Chunk& chunk) {
+    Record record;
+    if (!m_records.if_contains(chunk.getPosition(), [&] (const auto& entry) { record = entry.second; })) {
+        return false;
+    }
+
+    std::vector<byte> data(sizeof(RecordHeader) + record.size);
+    {
+        std::unique_lock<std::mutex> lock(m_file_mutex);
+        m_data_file.clear();
+        m_data_file.seekg(std::streamoff(record.offset));
+        if (!m_data_file.read(reinterpret_cast<char*>(data.data()), std::streamsize(data.size()))) {
+            m_data_file.clear();
+            return false;
+        }
+    }
+
+    RecordHeader header;
+    memcpy(&header, data.data(), sizeof(header));
+    const byte* payload = data.data() + sizeof(header);
+    if (header.magic != RECORD_MAGIC || header.payload_size != record.size ||
+            ChunkPosition(header.x, header.y, header.z) != chunk.getPosition() ||
+            hashBytes(payload, header.payload_size) != header.payload_checksum ||
+            !chunk.readBuffer(payload, i32(header.payload_size))) {
+        Logger().message(Logger::flag_error, "PackedChunkStorage", "invalid record of chunk %d %d %d in %s",
+                         chunk.getPosition().x, chunk.getPosition().y, chunk.getPosition().z, m_data_path.c_str());
+        return false;
+    }
+    m_loaded_chunks++;
+    return true;
+}
+
+bool PackedChunkStorage::mayContainChunk(ChunkSource& chunk_source, ChunkPosition position) {
+    return containsChunk(position);
+}
+
+bool PackedChunkStorage::isOpen() const {
+    return m_is_open;
+}
+
+bool PackedChunkStorage::containsChunk(ChunkPosition position) const {
+    return m_records.contains(position);
+}
+
+bool PackedChunkStorage::flush() {
+    if (!m_is_open) {
+        return false;
+    }
+    std::unique_lock<std::mutex> lock(m_file_mutex);
+    m_data_file.clear();
+    if (!m_data_file.flush()) {
+        return false;
+    }
+    return saveIndex();
+}
+
+PackedChunkStorage::Stats PackedChunkStorage::getStats() {
+    Stats stats;
+    {
+        std::unique_lock<std::mutex> lock(m_file_mutex);
+        stats.data_size = i64(m_data_size);
+    }
+    stats.chunk_count = i64(m_records.size());
+    stats.stored_chunks = m_stored_chunks;
+    stats.stored_bytes = m_stored_bytes;
+    stats.loaded_chunks = m_loaded_chunks;
+    stats.recovered_chunks = m_recovered_chunks;
+    stats.truncated_bytes = m_truncated_bytes;
+    return stats;
+}
+
+} // voxel
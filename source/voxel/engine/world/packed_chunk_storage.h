@@ -0,0 +1,90 @@
+#ifndef VOXEL_ENGINE_PACKED_CHUNK_STORAGE_H
+#define VOXEL_ENGINE_PACKED_CHUNK_STORAGE_H
+
+#include <string>
+#include <fstream>
+#include <mutex>
+#include <atomic>
+#include "voxel/common/base.h"
+#include "voxel/engine/world/chunk_storage.h"
+
+
+namespace voxel {
+
+/*
+ * Storage, that packs all chunks into a single append-only data file in a directory, with an index file of
+ * chunk record offsets next to it. Index is saved on flush, records, appended after the last saved index, are
+ * found by scanning the tail of the data file on open, and partially written last record is truncated, so
+ * storage always resumes from the last completely written chunk. Storing the same chunk again appends a new
+ * record, old one stays in the file, until it is repacked.
+ */
+class PackedChunkStorage : public ChunkStorage {
+public:
+    struct Stats {
+        // chunks in the storage and size of the data file in bytes
+        i64 chunk_count = 0;
+        i64 data_size = 0;
+
+        // chunks and bytes, written since the storage was opened
+        i64 stored_chunks = 0;
+        i64 stored_bytes = 0;
+        i64 loaded_chunks = 0;
+
+        // records, found by scanning the data file on open, and bytes of truncated incomplete record
+        i64 recovered_chunks = 0;
+        i64 truncated_bytes = 0;
+    };
+
+private:
+    struct Record {
+        u64 offset;
+        u32 size;
+    };
+
+    std::string m_directory;
+    std::string m_data_path;
+    std::string m_index_path;
+
+    std::mutex m_file_mutex;
+    std::fstream m_data_file;
+    u64 m_data_size = 0;
+    bool m_is_open = false;
+
+    // records are looked up from worker threads without taking the file mutex
+    concurrent_flat_hash_map<ChunkPosition, Record, 6> m_records;
+
+    std::atomic<i64> m_stored_chunks = 0;
+    std::atomic<i64> m_stored_bytes = 0;
+    std::atomic<i64> m_loaded_chunks = 0;
+    i64 m_recovered_chunks = 0;
+    i64 m_truncated_bytes = 0;
+
+public:
+    // opens or creates storage in the directory
+    explicit PackedChunkStorage(const std::string& directory);
+    PackedChunkStorage(const PackedChunkStorage&) = delete;
+    PackedChunkStorage(PackedChunkStorage&&) = delete;
+    // flushes data and saves index
+    ~PackedChunkStorage();
+
+    bool tryStoreChunk(ChunkSource& chunk_source, Chunk& chunk) override;
+    bool tryLoadChunk(ChunkSource& chunk_source, Chunk& chunk) override;
+    bool mayContainChunk(ChunkSource& chunk_source, ChunkPosition position) override;
+
+    // returns false, if data file cannot be opened or created
+    bool isOpen() const;
+    bool containsChunk(ChunkPosition position) const;
+    // flushes written data and saves index, returns false on failure
+    bool flush();
+    Stats getStats();
+
+private:
+    void open();
+    bool loadIndex(u64& indexed_data_size);
+    bool saveIndex();
+    void scanRecords(u64 offset);
+};
+
+} // voxel
+
+#endif //VOXEL_ENGINE_PACKED_CHUNK_STORAGE_H
@@ -0,0 +1,233 @@
+#include "terrain_chunk_provider.h"
+
+#include <cmath>
+#include <cstdio>
+#include "voxel/common/math/noise.h"
+#include "voxel/common/utils/time.h"
+#include "voxel/engine/world/chunk.h"
+
+
+namespace voxel {
+
+static inline f32 smoothstep(f32 edge0, f32 edge1, f32 x) {
+    f32 t = std::min(std::max((x - edge0) / (edge1 - edge0), 0.0f), 1.0f);
+    return t * t * (3.0f - 2.0f * t);
+}
+
+f64 TerrainChunkProvider::Stats::getChunksPerSecondPerCore() const {
+    return build_time > 0 ? f64(built_chunks) / (build_time / 1000.0) : 0.0;
+}
+
+TerrainChunkProvider::TerrainChunkProvider(Settings settings) : m_settings(settings) {
+    m_surface_voxels[BIOME_PLAINS] = Voxel::create(math::Color(0.30f, 0.60f, 0.20f));
+    m_soil_voxels[BIOME_PLAINS] = Voxel::create(math::Color(0.45f, 0.32f, 0.20f));
+    m_surface_voxels[BIOME_DESERT] = Voxel::create(math::Color(0.86f, 0.80f, 0.55f));
+    m_soil_voxels[BIOME_DESERT] = Voxel::create(math::Color(0.76f, 0.68f, 0.45f));
+    m_surface_voxels[BIOME_MOUNTAINS] = Voxel::create(math::Color(0.50f, 0.50f, 0.52f));
+    m_soil_voxels[BIOME_MOUNTAINS] = Voxel::create(math::Color(0.45f, 0.45f, 0.47f));
+    m_surface_voxels[BIOME_SNOW] = Voxel::create(math::Color(0.95f, 0.95f, 0.98f));
+    m_soil_voxels[BIOME_SNOW] = Voxel::create(math::Color(0.45f, 0.32f, 0.20f));
+    m_stone_voxel = Voxel::create(math::Color(0.40f, 0.40f, 0.42f));
+}
+
+bool TerrainChunkProvider::canFetchChunk(ChunkSource& chunk_source, ChunkPosition position) {
+    return position.y >= m_settings.min_chunk_y && position.y <= m_settings.max_chunk_y;
+}
+
+Unique<Chunk> TerrainChunkProvider::createChunk(ChunkSource& chunk_source, ChunkPosition position) {
+    return CreateUnique<Chunk>(position);
+}
+
+bool TerrainChunkProvider::buildChunk(ChunkSource& chunk_source, Chunk& chunk) {
+    u64 start = utils::getTimestampNanos();
+    const ChunkPosition& position = chunk.getPosition();
+    Shared<const Column> column = getColumn(position.x, position.z);
+
+    bool emitted = false;
+    i32 base_y = position.y << m_settings.chunk_scale;
+    if (base_y < column->max_heights[0][0]) {
+        for (u32 i = 0; i < 8; i++) {
+            emitted |= emitCell(chunk, *column, base_y, 1, i & 1u, (i >> 1) & 1u, (i >> 2) & 1u);
+        }
+    }
+
+    m_built_chunks++;
+    if (!emitted) {
+        m_empty_chunks++;
+    }
+    m_build_time += utils::getTimestampNanos() - start;
+    return true;
+}
+
+Shared<const TerrainChunkProvider::Column> TerrainChunkProvider::getColumn(i32 x, i32 z) {
+    ChunkPosition key(x, 0, z);
+    {
+        std::unique_lock<std::mutex> lock(m_column_cache_mutex);
+        auto it = m_column_cache.find(key);
+        if (it != m_column_cache.end()) {
+            m_column_lru.splice(m_column_lru.begin(), m_column_lru, it->second.lru_iterator);
+            m_column_cache_hits++;
+            return it->second.column;
+        }
+    }
+
+    // column is generated without the lock, if two threads generate the same column, the first one is kept
+    u64 start = utils::getTimestampNanos();
+    Shared<const Column> column = generateColumn(x, z);
+    m_column_time += utils::getTimestampNanos() - start;
+    m_column_cache_misses++;
+
+    std::unique_lock<std::mutex> lock(m_column_cache_mutex);
+    auto it = m_column_cache.find(key);
+    if (it != m_column_cache.end()) {
+        return it->second.column;
+    }
+    m_column_lru.push_front(key);
+    m_column_cache.emplace(key, CacheEntry { column, m_column_lru.begin() });
+    while (i32(m_column_cache.size()) > std::max(m_settings.column_cache_size, 1)) {
+        m_column_cache.erase(m_column_lru.back());
+        m_column_lru.pop_back();
+    }
+    return column;
+}
+
+bool TerrainChunkProvider::getGenerationIdentity(GenerationIdentity& identity) {
+    // all settings, except seed and cache size, change generated terrain
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer), "terrain:%d:%d:%d:%d:%d:%d:%g:%g:%d",
+             i32(m_settings.chunk_scale), m_settings.min_chunk_y, m_settings.max_chunk_y,
+             m_settings.base_height, m_settings.hills_height, m_settings.mountains_height,
+             m_settings.terrain_scale, m_settings.biome_scale, m_settings.soil_depth);
+    identity.provider_id = buffer;
+    identity.provider_version = GENERATOR_VERSION;
+    identity.seed = m_settings.seed;
+    return true;
+}
+
+const TerrainChunkProvider::Settings& TerrainChunkProvider::getSettings() const {
+    return m_settings;
+}
+
+TerrainChunkProvider::Stats TerrainChunkProvider::getStats() const {
+    Stats stats;
+    stats.built_chunks = m_built_chunks;
+    stats.empty_chunks = m_empty_chunks;
+    stats.column_cache_hits = m_column_cache_hits;
+    stats.column_cache_misses = m_column_cache_misses;
+    stats.build_time = f64(m_build_time) / 1000000.0;
+    stats.column_time = f64(m_column_time) / 1000000.0;
+    return stats;
+}
+
+Unique<TerrainChunkProvider::Column> TerrainChunkProvider::generateColumn(i32 x, i32 z) {
+    i32 scale = m_settings.chunk_scale;
+    i32 size = 1 << scale;
+    f32 x0 = f32(x * size);
+    f32 z0 = f32(z * size);
+
+    math::noise::FractalSettings hills_noise = { 5, 1.0f / m_settings.terrain_scale, 2.0f, 0.5f };
+    math::noise::FractalSettings ridges_noise = { 4, 1.0f / m_settings.terrain_scale, 2.0f, 0.45f };
+    math::noise::FractalSettings mountains_noise = { 2, 0.25f / m_settings.terrain_scale, 2.0f, 0.5f };
+    math::noise::FractalSettings temperature_noise = { 2, 1.0f / m_settings.biome_scale, 2.0f, 0.5f };
+
+    std::vector<f32> hills(size);
+    std::vector<f32> ridges(size);
+    std::vector<f32> mountains(size);
+    std::vector<f32> temperature(size);
+
+    Unique<Column> column = CreateUnique<Column>();
+    column->heights.resize(size * size);
+    column->biomes.resize(size * size);
+    for (i32 row = 0; row < size; row++) {
+        f32 row_z = z0 + f32(row);
+        math::noise::sampleFractalRow(math::noise::NOISE_GRADIENT, m_settings.seed, hills_noise, x0, row_z, 1.0f, size, hills.data());
+        math::noise::sampleFractalRow(math::noise::NOISE_GRADIENT, m_settings.seed + 1, ridges_noise, x0, row_z, 1.0f, size, ridges.data());
+        math::noise::sampleFractalRow(math::noise::NOISE_GRADIENT, m_settings.seed + 2, mountains_noise, x0, row_z, 1.0f, size, mountains.data());
+        math::noise::sampleFractalRow(math::noise::NOISE_VALUE, m_settings.seed + 3, temperature_noise, x0, row_z, 1.0f, size, temperature.data());
+
+        for (i32 i = 0; i < size; i++) {
+            // mountains are ridged noise, faded in by low frequency mask
+            f32 mountain_weight = smoothstep(0.05f, 0.35f, mountains[i]);
+            f32 ridge = 1.0f - std::abs(ridges[i]);
+            f32 height = f32(m_settings.base_height) + hills[i] * f32(m_settings.hills_height) +
+                    mountain_weight * ridge * ridge * f32(m_settings.mountains_height);
+
+            Biome biome;
+            if (mountain_weight > 0.5f) {
+                biome = height > f32(m_settings.base_height) + 0.55f * f32(m_settings.mountains_height) ? BIOME_SNOW : BIOME_MOUNTAINS;
+            } else if (temperature[i] > 0.25f) {
+                biome = BIOME_DESERT;
+            } else if (temperature[i] < -0.35f) {
+                biome = BIOME_SNOW;
+            } else {
+                biome = BIOME_PLAINS;
+            }
+
+            column->heights[i + row * size] = i32(std::floor(height));
+            column->biomes[i + row * size] = biome;
+        }
+    }
+
+    // build min/max pyramid from the heightmap up to a single cell
+    column->min_heights.resize(scale + 1);
+    column->max_heights.resize(scale + 1);
+    column->min_heights[scale] = column->heights;
+    column->max_heights[scale] = column->heights;
+    for (i32 level = scale - 1; level >= 0; level--) {
+        i32 level_size = 1 << level;
+        const std::vector<i32>& child_min = column->min_heights[level + 1];
+        const std::vector<i32>& child_max = column->max_heights[level + 1];
+        std::vector<i32>& level_min = column->min_heights[level];
+        std::vector<i32>& level_max = column->max_heights[level];
+        level_min.resize(level_size * level_size);
+        level_max.resize(level_size * level_size);
+        for (i32 cz = 0; cz < level_size; cz++) {
+            for (i32 cx = 0; cx < level_size; cx++) {
+                i32 i00 = cx * 2 + cz * 2 * level_size * 2;
+                i32 i10 = i00 + 1;
+                i32 i01 = i00 + level_size * 2;
+                i32 i11 = i01 + 1;
+                level_min[cx + cz * level_size] = std::min(std::min(child_min[i00], child_min[i10]), std::min(child_min[i01], child_min[i11]));
+                level_max[cx + cz * level_size] = std::max(std::max(child_max[i00], child_max[i10]), std::max(child_max[i01], child_max[i11]));
+            }
+        }
+    }
+    return column;
+}
+
+Voxel TerrainChunkProvider::getVoxelForDepth(Biome biome, i32 depth) {
+    if (depth == 0) {
+        return m_surface_voxels[biome];
+    }
+    return depth < m_settings.soil_depth ? m_soil_voxels[biome] : m_stone_voxel;
+}
+
+bool TerrainChunkProvider::emitCell(Chunk& chunk, const Column& column, i32 base_y, u8 scale, u32 x, u32 y, u32 z) {
+    i32 cell_size = 1 << (m_settings.chunk_scale - scale);
+    i32 cell_index = i32(x + (z << scale));
+    i32 y0 = base_y + i32(y) * cell_size;
+    i32 y1 = y0 + cell_size;
+
+    // cell is above the surface everywhere
+    if (y0 >= column.max_heights[scale][cell_index]) {
+        return false;
+    }
+    // cell is below the soil layer everywhere, so it is emitted as single large stone voxel
+    if (y1 <= column.min_heights[scale][cell_index] - m_settings.soil_depth) {
+        chunk.setVoxel({ scale, x, y, z }, m_stone_voxel);
+        return true;
+    }
+    // single voxel at the surface or in the soil layer
+    if (scale == m_settings.chunk_scale) {
+        chunk.setVoxel({ scale, x, y, z }, getVoxelForDepth(column.biomes[cell_index], column.heights[cell_index] - 1 - y0));
+        return true;
+    }
+
+    bool emitted = false;
+    for (u32 i = 0; i < 8; i++) {
+        emitted |= emitCell(chunk, column, base_y, scale + 1, (x << 1) | (i & 1u), (y << 1) | ((i >> 1) & 1u), (z << 1) | ((i >> 2) & 1u));
+    }
+    return emitted;
+}
+
+} // voxel
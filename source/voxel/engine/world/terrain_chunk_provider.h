@@ -0,0 +1,133 @@
+#ifndef VOXEL_ENGINE_TERRAIN_CHUNK_PROVIDER_H
+#define VOXEL_ENGINE_TERRAIN_CHUNK_PROVIDER_H
+
+#include <list>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include "voxel/common/base.h"
+#include "voxel/engine/shared/voxel.h"
+#include "voxel/engine/world/chunk_provider.h"
+
+
+namespace voxel {
+
+/*
+ * Procedural heightmap terrain with biomes. Heightmap and biomes of each (x, z) column of chunks are generated once
+ * and kept in the column cache, so all vertically stacked chunks reuse them. Each column also keeps min and max
+ * heights for every octree level, so fully solid and fully empty cells are found without checking single voxels
+ * and solid underground regions are emitted as large octree cells.
+ */
+class TerrainChunkProvider : public ChunkProvider {
+public:
+    // version of generation algorithm, must be incremented on every change of generated terrain
+    static const u32 GENERATOR_VERSION = 1;
+
+    enum Biome : u8 {
+        BIOME_PLAINS,
+        BIOME_DESERT,
+        BIOME_MOUNTAINS,
+        BIOME_SNOW
+    };
+
+    struct Settings {
+        // seed of all noise layers
+        u32 seed = 0;
+
+        // chunk has 2^chunk_scale voxels along each axis
+        u8 chunk_scale = 5;
+
+        // generated chunks are limited to this range of chunk y
+        i32 min_chunk_y = -2;
+        i32 max_chunk_y = 8;
+
+        // terrain heights in voxels: base level, max height of hills above it and max height of mountains above it
+        i32 base_height = 24;
+        i32 hills_height = 16;
+        i32 mountains_height = 160;
+
+        // horizontal size of terrain features and biomes in voxels
+        f32 terrain_scale = 192;
+        f32 biome_scale = 1024;
+
+        // depth of biome specific surface layer in voxels, everything below is stone
+        i32 soil_depth = 4;
+
+        // max amount of cached chunk columns
+        i32 column_cache_size = 4096;
+    };
+
+    struct Column {
+        // surface height and biome for each voxel column, indexed as x + z * size
+        std::vector<i32> heights;
+        std::vector<Biome> biomes;
+
+        // min and max height over each cell of every octree level, level L has 2^L x 2^L cells
+        std::vector<std::vector<i32>> min_heights;
+        std::vector<std::vector<i32>> max_heights;
+    };
+
+    struct Stats {
+        i64 built_chunks = 0;
+        // chunks, that were above or below the terrain surface and got no voxels
+        i64 empty_chunks = 0;
+        i64 column_cache_hits = 0;
+        i64 column_cache_misses = 0;
+
+        // total time in milliseconds, spent in buildChunk over all threads, and part of it, spent generating columns
+        f64 build_time = 0;
+        f64 column_time = 0;
+
+        // single thread generation throughput
+        f64 getChunksPerSecondPerCore() const;
+    };
+
+private:
+    struct CacheEntry {
+        Shared<const Column> column;
+        std::list<ChunkPosition>::iterator lru_iterator;
+    };
+
+    Settings m_settings;
+
+    // voxels of the top layer and the rest of soil layer for each biome
+    Voxel m_surface_voxels[4];
+    Voxel m_soil_voxels[4];
+    Voxel m_stone_voxel;
+
+    std::mutex m_column_cache_mutex;
+    flat_hash_map<ChunkPosition, CacheEntry> m_column_cache;
+    // most recently used columns go first
+    std::list<ChunkPosition> m_column_lru;
+
+    std::atomic<i64> m_built_chunks = 0;
+    std::atomic<i64> m_empty_chunks = 0;
+    std::atomic<i64> m_column_cache_hits = 0;
+    std::atomic<i64> m_column_cache_misses = 0;
+    std::atomic<u64> m_build_time = 0;
+    std::atomic<u64> m_column_time = 0;
+
+public:
+    TerrainChunkProvider(Settings settings);
+
+    bool canFetchChunk(ChunkSource& chunk_source, ChunkPosition position) override;
+    Unique<Chunk> createChunk(ChunkSource& chunk_source, ChunkPosition position) override;
+    bool buildChunk(ChunkSource& chunk_source, Chunk& chunk) override;
+    bool getGenerationIdentity(GenerationIdentity& identity) override;
+
+    // returns cached column for given chunk x and z or generates it
+    Shared<const Column> getColumn(i32 x, i32 z);
+
+    const Settings& getSettings() const;
+    Stats getStats() const;
+
+private:
+    Unique<Column> generateColumn(i32 x, i32 z);
+    Voxel getVoxelForDepth(Biome biome, i32 depth);
+    // returns true, if anything was emitted
+    bool emitCell(Chunk& chunk, const Column& column, i32 base_y, u8 scale, u32 x, u32 y, u32 z);
+};
+
+} // voxel
+
+#endif //VOXEL_ENGINE_TERRAIN_CHUNK_PROVIDER_H
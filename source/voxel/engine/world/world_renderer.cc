@@ -1,25 +1,39 @@
 #include "world_renderer.h"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include "voxel/common/profiler.h"
+#include "voxel/common/utils/time.h"
 
 
 namespace voxel {
 
 WorldRenderer::WorldRenderer(Shared<ChunkSource> chunk_source, Unique<render::ChunkBuffer> chunk_buffer, WorldRendererSettings settings) :
-    m_chunk_source(chunk_source), m_chunk_buffer(std::move(chunk_buffer)), m_settings(settings) {
+    m_chunk_source(chunk_source), m_chunk_buffer(std::move(chunk_buffer)), m_settings(settings), m_prefetcher(settings.prefetch) {
     m_chunk_source->addListener(this);
     m_chunk_buffer->rebuildChunkMap(m_chunk_map_offset_position);
     m_camera_loading_region = m_chunk_source->addLoadingRegion(m_chunk_map_offset_position, m_settings.chunk_loading_level);
+    m_camera_loading_region->setShape(m_settings.chunk_loading_shape, m_settings.chunk_loading_vertical_scale);
+    if (m_prefetcher.isEnabled()) {
+        m_prefetch_loading_region = m_chunk_source->addLoadingRegion(m_chunk_map_offset_position,
+                                                                     ChunkSource::LoadingRegion::LEVEL_LOAD + m_settings.prefetch.radius);
+        m_prefetch_loading_region->setCancelsTasksOnJump(false);
+        m_prefetch_loading_region->setShape(REGION_SHAPE_SPHERE);
+    }
 }
 
 WorldRenderer::~WorldRenderer() {
+    if (m_prefetch_loading_region) {
+        m_chunk_source->removeLoadingRegion(m_prefetch_loading_region);
+    }
     m_chunk_source->removeLoadingRegion(m_camera_loading_region);
     m_chunk_source->removeListener(this);
 }
 
 void WorldRenderer::setCameraPosition(math::Vec3f camera_position) {
     m_camera_position = camera_position;
+    m_prefetcher.updateCamera(camera_position, utils::getTimestampNanos());
     math::Vec3i camera_chunk_position = math::floor_to_int(m_camera_position);
     m_camera_loading_region->setPosition(camera_chunk_position);
     if (math::len(camera_chunk_position - m_chunk_map_offset_position) > m_settings.buffer_offset_update_distance) {
@@ -28,6 +42,25 @@ void WorldRenderer::setCameraPosition(math::Vec3f camera_position) {
     }
 }
 
+void WorldRenderer::setCameraView(math::Vec3f direction, f32 fov) {
+    f32 direction_length = math::len(direction);
+    math::Vec3f view_direction = direction_length > 0.0f ? direction / direction_length : math::Vec3f(0.0f);
+    // rebuilding loading level grid each frame, while camera rotates, is too expensive, so small changes are ignored
+    bool had_view = math::len_sq(m_camera_view_direction) > 0.0f;
+    bool has_view = direction_length > 0.0f;
+    if (had_view == has_view && std::abs(fov - m_camera_view_fov) <= m_settings.view_update_angle &&
+            (!has_view || math::dot(view_direction, m_camera_view_direction) >= cos(m_settings.view_update_angle))) {
+        return;
+    }
+    m_camera_view_direction = view_direction;
+    m_camera_view_fov = fov;
+    m_camera_loading_region->setView(view_direction, fov, m_settings.view_back_falloff);
+}
+
+math::Vec3f WorldRenderer::getCameraVelocity() {
+    return m_prefetcher.getVelocity();
+}
+
 void WorldRenderer::addChunkToUpdateQueue(ChunkRef chunk_ref) {
     m_chunk_updates.push(chunk_ref);
 }
@@ -48,6 +81,7 @@ void WorldRenderer::onTick() {
         m_chunk_buffer->rebuildChunkMap(m_chunk_map_offset_position);
     }
     fetchRequestedChunks();
+    fetchPredictedChunks();
     runChunkUpdates();
 }
 
@@ -56,14 +90,16 @@ void WorldRenderer::fetchRequestedChunks() {
 
     // if there remaining chunks to fetch
     if (m_fetched_chunks_list.hasNext()) {
-        // fetch some chunks, requested by gpu
+        // fetch some chunks, requested by gpu, in a single batch
+        m_chunk_fetch_batch.clear();
         for (i32 i = 0; i < m_settings.chunk_fetches_per_tick && m_fetched_chunks_list.hasNext(); i++) {
             auto chunk_to_fetch = m_fetched_chunks_list.next();
-            i64 priority = m_chunk_fetch_priority * 64 + chunk_to_fetch.weight;
-            m_chunk_source->fetchChunkAt(chunk_to_fetch.pos, priority, [&] (Chunk& chunk) {
-                m_chunk_buffer->updateChunkPriority(chunk, priority);
-            });
+            i64 weight = std::min<i64>(chunk_to_fetch.weight, 63);
+            m_chunk_fetch_batch.push_back({ chunk_to_fetch.pos, m_chunk_fetch_priority * 128 + 64 + weight });
         }
+        m_chunk_source->fetchChunksAt(m_chunk_fetch_batch, [&] (Chunk& chunk, i32 index) {
+            m_chunk_buffer->updateChunkPriority(chunk, m_chunk_fetch_batch[index].priority);
+        });
 
         // if all chunks fetched - request more
         if (!m_fetched_chunks_list.hasNext()) {
@@ -83,30 +119,53 @@ void WorldRenderer::fetchRequestedChunks() {
     }
 }
 
+void WorldRenderer::fetchPredictedChunks() {
+    VOXEL_ENGINE_PROFILE_SCOPE(world_renderer_prefetch_chunks);
+
+    if (!m_prefetch_loading_region) {
+        return;
+    }
+    math::Vec3i predicted_position = math::floor_to_int(m_prefetcher.getPredictedPosition());
+    math::Vec3i region_position = m_prefetch_loading_region->getPosition();
+    if (predicted_position.x != region_position.x || predicted_position.y != region_position.y || predicted_position.z != region_position.z) {
+        m_prefetch_loading_region->setPosition(predicted_position);
+    }
+
+    // chunks, that will be reached soon, are fetched right below chunks, requested by gpu in the current round,
+    // so visible chunks are always built first, but prefetched chunks go before requests of all previous rounds
+    m_prefetch_batch.clear();
+    if (m_prefetcher.collectFetches(m_prefetch_batch, m_chunk_fetch_priority * 128 + 63) > 0) {
+        m_chunk_source->fetchChunksAt(m_prefetch_batch, [&] (Chunk& chunk, i32 index) {
+            m_chunk_buffer->updateChunkPriority(chunk, m_prefetch_batch[index].priority);
+        });
+    }
+}
+
 void WorldRenderer::runChunkUpdates() {
     VOXEL_ENGINE_PROFILE_SCOPE(world_renderer_update_chunks);
 
+    m_chunk_update_batch.clear();
     for (i32 i = 0; i < m_settings.chunk_updates_per_tick; i++) {
         auto next = m_chunk_updates.tryPop();
-        if (next.has_value()) {
-            ChunkRef chunk_ref = next.value();
-            m_chunk_source->accessChunk<chunk_access_policy_weak>(chunk_ref, [&](Chunk& chunk) {
-                if (chunk.getState() == CHUNK_LOADED) {
-                    m_chunk_buffer->uploadChunk(chunk, /* minimal non-zero priority */ 1);
-                } else {
-                    m_chunk_buffer->removeChunk(chunk_ref);
-                }
-            }, [&] (bool exists) {
-                if (exists) {
-                    m_chunk_updates.push(chunk_ref);
-                } else {
-                    m_chunk_buffer->removeChunk(chunk_ref);
-                };
-            });
-        } else {
+        if (!next.has_value()) {
             break;
         }
+        m_chunk_update_batch.emplace_back(next.value());
     }
+
+    m_chunk_source->accessChunks<chunk_access_policy_weak>(m_chunk_update_batch, [&](Chunk& chunk, i32 index) {
+        if (chunk.getState() == CHUNK_LOADED) {
+            m_chunk_buffer->uploadChunk(chunk, /* minimal non-zero priority */ 1);
+        } else {
+            m_chunk_buffer->removeChunk(m_chunk_update_batch[index]);
+        }
+    }, [&] (bool exists, i32 index) {
+        if (exists) {
+            m_chunk_updates.push(m_chunk_update_batch[index]);
+        } else {
+            m_chunk_buffer->removeChunk(m_chunk_update_batch[index]);
+        }
+    });
 }
 
 void WorldRenderer::onChunkSourceTick(ChunkSource& chunk_source) {
@@ -117,4 +176,8 @@ void WorldRenderer::onChunkUpdated(ChunkSource& chunk_source, ChunkRef chunk_ref
     addChunkToUpdateQueue(chunk_ref);
 }
 
+void WorldRenderer::onChunksUpdated(ChunkSource& chunk_source, const std::vector<ChunkRef>& chunk_refs) {
+    m_chunk_updates.pushAll(chunk_refs);
+}
+
 } // voxel
\ No newline at end of file
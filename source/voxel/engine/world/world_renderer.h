@@ -7,6 +7,7 @@
 #include "voxel/engine/render/render_context.h"
 #include "voxel/engine/render/chunk_buffer.h"
 #include "voxel/engine/world/chunk_source.h"
+#include "voxel/engine/world/chunk_prefetcher.h"
 
 
 namespace voxel {
@@ -23,6 +24,21 @@ struct WorldRendererSettings {
 
     // loading level for camera region
     i32 chunk_loading_level = 40;
+
+    // shape of camera region, REGION_SHAPE_SPHERE keeps about half as many chunks loaded, as the cube of the same
+    // radius, vertical scale above 1 shrinks its vertical radius for mostly horizontal worlds
+    LoadingRegionShape chunk_loading_shape = REGION_SHAPE_CUBE;
+    f32 chunk_loading_vertical_scale = 1.0f;
+
+    // loading levels, that camera region loses directly behind the camera, chunks outside of the view cone are
+    // kept lazy or unloaded closer to the camera, than visible ones, 0 makes camera region the same in all directions
+    i32 view_back_falloff = 4;
+
+    // camera region view is updated, when camera direction or fov changes more, than by this angle in radians
+    f32 view_update_angle = 0.1f;
+
+    // chunks along the predicted camera path are fetched ahead of the camera, see ChunkPrefetcher
+    ChunkPrefetcher::Settings prefetch;
 };
 
 class WorldRenderer : public ChunkSourceListener {
@@ -33,13 +49,23 @@ class WorldRenderer : public ChunkSourceListener {
     math::Vec3i m_chunk_map_offset_position = math::Vec3i(0);
     std::atomic<bool> m_rebuild_chunk_map = false;
     Shared<ChunkSource::LoadingRegion> m_camera_loading_region;
+    math::Vec3f m_camera_view_direction = math::Vec3f(0.0f);
+    f32 m_camera_view_fov = 0.0f;
+    // follows the end of predicted camera path, keeps prefetched chunks loaded, null, if prefetching is disabled
+    Shared<ChunkSource::LoadingRegion> m_prefetch_loading_region;
 
     WorldRendererSettings m_settings;
+    ChunkPrefetcher m_prefetcher;
     render::FetchedChunksList m_fetched_chunks_list;
     std::atomic<bool> m_request_fetched_chunks = true;
+    // each round of gpu requests owns 128 priorities, requested chunks take the upper half, prefetched ones - the lower
     i64 m_chunk_fetch_priority = 0;
 
     threading::UniqueBlockingQueue<ChunkRef> m_chunk_updates;
+    // reused each tick for batched chunk access
+    std::vector<ChunkSource::ChunkFetch> m_chunk_fetch_batch;
+    std::vector<ChunkRef> m_chunk_update_batch;
+    std::vector<ChunkSource::ChunkFetch> m_prefetch_batch;
 
 public:
     WorldRenderer(Shared<ChunkSource> chunk_source, Unique<render::ChunkBuffer> chunk_buffer, WorldRendererSettings settings);
@@ -49,14 +75,19 @@ public:
 
     void addChunkToUpdateQueue(ChunkRef chunk_ref);
     void setCameraPosition(math::Vec3f camera_position);
+    // direction and full view angle in radians (diagonal for rectangular views), zero direction disables view falloff
+    void setCameraView(math::Vec3f direction, f32 fov);
+    math::Vec3f getCameraVelocity();
     void render(render::RenderContext& render_context);
     void onTick();
 
 private:
     void onChunkSourceTick(ChunkSource &chunk_source) override;
     void onChunkUpdated(ChunkSource &chunk_source, ChunkRef chunk_ref) override;
+    void onChunksUpdated(ChunkSource &chunk_source, const std::vector<ChunkRef>& chunk_refs) override;
 
     void fetchRequestedChunks();
+    void fetchPredictedChunks();
     void runChunkUpdates();
 };
 
@@ -3,6 +3,7 @@
 #include <fstream>
 #include "voxel/engine/world/chunk_provider.h"
 #include "voxel/engine/world/chunk_storage.h"
+#include "voxel/engine/world/model_chunk_provider.h"
 #include "voxel/engine/file/vox_file_format.h"
 
 
@@ -16,6 +17,14 @@ Unique<VoxelModel> loadVoxelModelFromVoxFile(const std::string& filename) {
     return !models.empty() ? CreateUnique<VoxelModel>(std::move(models[0])) : nullptr;
 }
 
+format::VoxScene loadVoxSceneFromVoxFile(const std::string& filename) {
+    format::VoxFileFormat file_format;
+    std::ifstream istream(filename, std::ifstream::binary);
+    format::VoxScene scene = file_format.readScene(istream);
+    istream.close();
+    return scene;
+}
+
 
 class SingleChunkModelChunkProvider : public ChunkProvider {
     Unique<VoxelModel> m_model;
@@ -76,4 +85,26 @@ Unique<World> createWorldFromModel(Unique<VoxelModel> model, Voxel ground_voxel)
     return world;
 }
 
+Unique<World> createWorldFromVoxScene(const format::VoxScene& scene, i32 scale) {
+    Unique<ModelChunkProvider> provider = CreateUnique<ModelChunkProvider>(ModelChunkProvider::Settings());
+    for (auto& instance : scene.instances) {
+        provider->addModel({ scene.models[instance.model_index], instance.position * scale, scale, instance.rotation });
+    }
+    Unique<World> world = CreateUnique<World>(
+            std::move(provider),
+            CreateUnique<ChunkStorage>(),
+            threading::TickingThread::TicksPerSecond(20),
+            ChunkSource::Settings());
+    return world;
+}
+
+Unique<World> createWorldWithTerrain(TerrainChunkProvider::Settings settings) {
+    Unique<World> world = CreateUnique<World>(
+            CreateUnique<TerrainChunkProvider>(settings),
+            CreateUnique<ChunkStorage>(),
+            threading::TickingThread::TicksPerSecond(20),
+            ChunkSource::Settings());
+    return world;
+}
+
 } //
\ No newline at end of file
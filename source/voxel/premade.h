@@ -4,14 +4,23 @@
 #include "voxel/common/base.h"
 #include "voxel/engine/world.h"
 #include "voxel/engine/shared/voxel_model.h"
+#include "voxel/engine/file/vox_file_format.h"
+#include "voxel/engine/world/terrain_chunk_provider.h"
 
 
 namespace voxel {
 
 Unique<VoxelModel> loadVoxelModelFromVoxFile(const std::string& filename);
 
+format::VoxScene loadVoxSceneFromVoxFile(const std::string& filename);
+
 Unique<World> createWorldFromModel(Unique<VoxelModel> model, Voxel ground_voxel);
 
+// places all scene instances with the given scale, each model is shared by all its instances
+Unique<World> createWorldFromVoxScene(const format::VoxScene& scene, i32 scale = 1);
+
+Unique<World> createWorldWithTerrain(TerrainChunkProvider::Settings settings);
+
 } // voxel
 
 #endif //VOXEL_ENGINE_PREMADE_H
@@ -0,0 +1,425 @@
+/*
+ * Headless chunk pipeline benchmark. Drives ChunkSource with a synthetic moving loading region and
+ * renderer-like fetch pattern, without window or GPU, and reports throughput of each pipeline stage,
+ * tail latencies, peak memory and contention of concurrent chunk access for each worker thread count.
+ * Structures provider places trees across chunk borders through pending edits, and the run fails, if any emitted
+ * edit is neither applied, nor reported as dropped or expired, nor still pending.
+ *
+ * usage: chunk_pipeline_benchmark [--threads 1,2,4,8] [--seconds 10] [--radius 8] [--pattern static|walk|jump]
+ *                                 [--speed 4] [--provider terrain|flat|structures] [--lazy-compression] [--readers 4]
+ *                                 [--memory-budget-mb 0] [--shape cube|sphere] [--vertical-scale 1]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <fstream>
+#include <unistd.h>
+
+#include "voxel/common/base.h"
+#include "voxel/common/metrics.h"
+#include "voxel/common/utils/time.h"
+#include "voxel/engine/world/chunk.h"
+#include "voxel/engine/world/chunk_source.h"
+#include "voxel/engine/world/chunk_storage.h"
+#include "voxel/engine/world/terrain_chunk_provider.h"
+
+
+using namespace voxel;
+
+struct BenchmarkSettings {
+    std::vector<i32> thread_counts = { 1, 2, 4, 8 };
+    f64 seconds = 10;
+    i32 radius = 8;
+    std::string pattern = "walk";
+    // region speed in chunks per second for walk pattern, jump pattern teleports every 64 / speed seconds
+    f64 speed = 4;
+    std::string provider = "terrain";
+    bool lazy_compression = false;
+    // chunk memory budget in MiB, 0 disables the budget
+    i64 memory_budget_mb = 0;
+    // threads, hammering loaded chunks with fetches and strong accesses after the main run, 0 disables
+    i32 readers = 4;
+    // interval between ticks in milliseconds
+    i32 tick_interval = 10;
+    // shape of loading region, only chunks within its load level are fetched
+    std::string shape = "cube";
+    f32 vertical_scale = 1.0f;
+};
+
+// flat single layer terrain, measures pipeline overhead rather than generation
+class FlatChunkProvider : public ChunkProvider {
+public:
+    bool canFetchChunk(ChunkSource& chunk_source, ChunkPosition position) override {
+        return position.y >= -1 && position.y <= 1;
+    }
+
+    Unique<Chunk> createChunk(ChunkSource& chunk_source, ChunkPosition position) override {
+        return CreateUnique<Chunk>(position);
+    }
+
+    bool buildChunk(ChunkSource& chunk_source, Chunk& chunk) override {
+        if (chunk.getPosition().y == 0) {
+            for (u32 x = 0; x < 32; x++) {
+                for (u32 z = 0; z < 32; z++) {
+                    chunk.setVoxel({ 5, x, 0, z }, Voxel { 0x1F80A040u, 0 });
+                }
+            }
+        }
+        return true;
+    }
+};
+
+// flat terrain with a tree in each chunk, that crosses chunk borders, its parts outside of the chunk are added as
+// pending edits of neighbour chunks
+class StructureChunkProvider : public FlatChunkProvider {
+    std::atomic<i64> m_emitted_edits = 0;
+
+public:
+    bool buildChunk(ChunkSource& chunk_source, Chunk& chunk) override {
+        FlatChunkProvider::buildChunk(chunk_source, chunk);
+        ChunkPosition position = chunk.getPosition();
+        if (position.y != 0) {
+            return true;
+        }
+
+        // trunk stands near the chunk corner, so the crown reaches neighbours along x, z and the chunk above
+        u32 hash = u32(position.x) * 73856093u ^ u32(position.z) * 19349663u;
+        i32 trunk_x = 26 + i32(hash % 6);
+        i32 trunk_z = 26 + i32((hash >> 8) % 6);
+        flat_hash_map<ChunkPosition, std::vector<ChunkPendingEdits::Edit>> edits;
+        auto place = [&] (i32 x, i32 y, i32 z, Voxel voxel) {
+            ChunkPosition target(position.x + (x >> 5), position.y + (y >> 5), position.z + (z >> 5));
+            VoxelPosition local = { 5, u32(x & 31), u32(y & 31), u32(z & 31) };
+            if (target == position) {
+                chunk.setVoxel(local, voxel);
+            } else {
+                edits[target].emplace_back(ChunkPendingEdits::Edit::create(local, voxel));
+            }
+        };
+        for (i32 y = 1; y < 38; y++) {
+            place(trunk_x, y, trunk_z, Voxel { 0x1F603010u, 0 });
+        }
+        for (i32 x = -4; x <= 4; x++) {
+            for (i32 y = -4; y <= 4; y++) {
+                for (i32 z = -4; z <= 4; z++) {
+                    if (x * x + y * y + z * z <= 16) {
+                        place(trunk_x + x, 38 + y, trunk_z + z, Voxel { 0x1F20A020u, 0 });
+                    }
+                }
+            }
+        }
+
+        // edits are counted after they are added, so chunk source metrics never lag behind the emitted count
+        for (auto& target_edits : edits) {
+            chunk_source.addPendingEdits(target_edits.first, target_edits.second);
+            m_emitted_edits += i64(target_edits.second.size());
+        }
+        return true;
+    }
+
+    i64 getEmittedEdits() const {
+        return m_emitted_edits;
+    }
+};
+
+static i64 getResidentMemory() {
+    std::ifstream statm("/proc/self/statm");
+    i64 total_pages = 0, resident_pages = 0;
+    if (!(statm >> total_pages >> resident_pages)) {
+        return 0;
+    }
+    return resident_pages * i64(sysconf(_SC_PAGESIZE));
+}
+
+static std::vector<i32> parseList(const char* value) {
+    std::vector<i32> result;
+    std::string str(value);
+    size_t start = 0;
+    while (start < str.size()) {
+        size_t end = str.find(',', start);
+        if (end == std::string::npos) {
+            end = str.size();
+        }
+        result.emplace_back(std::atoi(str.substr(start, end - start).c_str()));
+        start = end + 1;
+    }
+    return result;
+}
+
+static bool parseArguments(i32 argc, char** argv, BenchmarkSettings& settings) {
+    for (i32 i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (arg == "--lazy-compression") {
+            settings.lazy_compression = true;
+            continue;
+        }
+        if (value == nullptr) {
+            std::fprintf(stderr, "missing value for %s\n", arg.c_str());
+            return false;
+        }
+        i++;
+        if (arg == "--threads") {
+            settings.thread_counts = parseList(value);
+        } else if (arg == "--seconds") {
+            settings.seconds = std::atof(value);
+        } else if (arg == "--radius") {
+            settings.radius = std::atoi(value);
+        } else if (arg == "--pattern") {
+            settings.pattern = value;
+        } else if (arg == "--speed") {
+            settings.speed = std::atof(value);
+        } else if (arg == "--provider") {
+            settings.provider = value;
+        } else if (arg == "--readers") {
+            settings.readers = std::atoi(value);
+        } else if (arg == "--memory-budget-mb") {
+            settings.memory_budget_mb = std::atoll(value);
+        } else if (arg == "--tick-interval") {
+            settings.tick_interval = std::atoi(value);
+        } else if (arg == "--shape") {
+            settings.shape = value;
+        } else if (arg == "--vertical-scale") {
+            settings.vertical_scale = f32(std::atof(value));
+        } else {
+            std::fprintf(stderr, "unknown argument %s\n", arg.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+static math::Vec3i getRegionPosition(const BenchmarkSettings& settings, f64 time) {
+    if (settings.pattern == "walk") {
+        return math::Vec3i(i32(time * settings.speed), 0, 0);
+    } else if (settings.pattern == "jump") {
+        f64 jump_interval = 64.0 / std::max(settings.speed, 0.001);
+        return math::Vec3i(i32(time / jump_interval) * 64, 0, 0);
+    }
+    return math::Vec3i(0, 0, 0);
+}
+
+static void printHistogram(const char* name, const MetricsRegistry::HistogramSnapshot& histogram, f64 seconds) {
+    std::printf("    %-24s %9lld %10.1f/s  mean %8.3f  p50 %8.3f  p90 %8.3f  p99 %8.3f  max %8.3f ms\n",
+                name, (long long) histogram.count, f64(histogram.count) / seconds,
+                histogram.getMean(), histogram.p50, histogram.p90, histogram.p99, histogram.max);
+}
+
+static void runContention(ChunkSource& chunk_source, const std::vector<ChunkPosition>& positions, i32 readers) {
+    if (readers <= 0 || positions.empty()) {
+        return;
+    }
+    std::atomic<bool> running = true;
+    std::atomic<i64> operations = 0;
+    std::atomic<i64> failed = 0;
+    std::vector<std::thread> threads;
+    for (i32 t = 0; t < readers; t++) {
+        threads.emplace_back([&, t] () {
+            std::mt19937 random(u32(t + 1));
+            std::uniform_int_distribution<size_t> index(0, positions.size() - 1);
+            i64 local_operations = 0;
+            i64 local_failed = 0;
+            while (running) {
+                ChunkPosition position = positions[index(random)];
+                bool acquired = (local_operations & 1) ?
+                        chunk_source.fetchChunkAt(position, 0, [] (Chunk&) {}) :
+                        chunk_source.accessChunk<chunk_access_policy_strong>(ChunkRef(position), [] (Chunk&) {});
+                local_operations++;
+                local_failed += acquired ? 0 : 1;
+            }
+            operations += local_operations;
+            failed += local_failed;
+        });
+    }
+
+    u64 start = utils::getTimestampNanos();
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    running = false;
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    f64 seconds = f64(utils::getTimestampNanos() - start) / 1e9;
+    std::printf("  contention: %d readers  %.0f accesses/s  %.2f%% not acquired\n",
+                readers, f64(operations) / seconds, operations > 0 ? 100.0 * f64(failed) / f64(operations) : 0.0);
+}
+
+// waits for queued chunk tasks and checks, that each emitted edit is applied, dropped, expired or still pending
+static bool checkPendingEdits(ChunkSource& chunk_source, StructureChunkProvider& provider) {
+    u64 start = utils::getTimestampNanos();
+    while (chunk_source.getMetricsSnapshot().gauges["tasks_in_queue"] > 0 && f64(utils::getTimestampNanos() - start) / 1e9 < 5.0) {
+        chunk_source.onTick();
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    chunk_source.onTick();
+
+    i64 emitted = provider.getEmittedEdits();
+    MetricsRegistry::Snapshot snapshot = chunk_source.getMetricsSnapshot();
+    i64 applied = snapshot.counters["pending_edits_applied"];
+    i64 dropped = snapshot.counters["pending_edits_dropped"];
+    i64 expired = snapshot.counters["pending_edits_expired"];
+    i64 pending = snapshot.gauges["pending_edits"];
+    i64 unaccounted = emitted - applied - dropped - expired - pending;
+    std::printf("  pending edits: emitted %lld  applied %lld  dropped %lld  expired %lld  pending %lld  unaccounted %lld\n",
+                (long long) emitted, (long long) applied, (long long) dropped, (long long) expired, (long long) pending, (long long) unaccounted);
+    return unaccounted == 0;
+}
+
+static bool runBenchmark(const BenchmarkSettings& settings, i32 thread_count) {
+    Unique<ChunkProvider> provider;
+    TerrainChunkProvider* terrain_provider = nullptr;
+    StructureChunkProvider* structure_provider = nullptr;
+    i32 min_y = -1, max_y = 1;
+    if (settings.provider == "terrain") {
+        TerrainChunkProvider::Settings terrain_settings;
+        terrain_settings.seed = 1;
+        terrain_settings.max_chunk_y = 3;
+        min_y = terrain_settings.min_chunk_y;
+        max_y = terrain_settings.max_chunk_y;
+        auto terrain = CreateUnique<TerrainChunkProvider>(terrain_settings);
+        terrain_provider = terrain.get();
+        provider = std::move(terrain);
+    } else if (settings.provider == "structures") {
+        auto structures = CreateUnique<StructureChunkProvider>();
+        structure_provider = structures.get();
+        provider = std::move(structures);
+    } else {
+        provider = CreateUnique<FlatChunkProvider>();
+    }
+
+    ChunkSource::Settings source_settings;
+    source_settings.worker_threads = thread_count;
+    source_settings.lazy_chunk_compression = settings.lazy_compression;
+    source_settings.chunk_unload_timeout = 2000;
+    source_settings.memory_budget = settings.memory_budget_mb * 1048576;
+    Unique<ChunkSource> chunk_source = CreateUnique<ChunkSource>(std::move(provider), CreateUnique<ChunkStorage>(), source_settings);
+    auto region = chunk_source->addLoadingRegion(math::Vec3i(0, 0, 0), ChunkSource::LoadingRegion::LEVEL_LOAD + settings.radius);
+    region->setShape(settings.shape == "sphere" ? REGION_SHAPE_SPHERE : REGION_SHAPE_CUBE, settings.vertical_scale);
+
+    // time from the first fetch of a position to the first fetch, that found it loaded
+    MetricsRegistry benchmark_metrics;
+    MetricsRegistry::Histogram& fetch_to_loaded = benchmark_metrics.getHistogram("fetch_to_loaded");
+    flat_hash_map<ChunkPosition, u64> first_fetch;
+    flat_hash_set<ChunkPosition> loaded_positions;
+
+    // chunks, that the region keeps loaded or lazy, in the fetched height range
+    i64 region_load_chunks = 0, region_lazy_chunks = 0;
+    for (i32 x = -settings.radius - 2; x <= settings.radius + 2; x++) {
+        for (i32 z = -settings.radius - 2; z <= settings.radius + 2; z++) {
+            for (i32 y = min_y; y <= max_y; y++) {
+                i32 level = region->getLoadingLevelAt(ChunkPosition(x, y, z));
+                region_load_chunks += level >= ChunkSource::LoadingRegion::LEVEL_LOAD ? 1 : 0;
+                region_lazy_chunks += level >= ChunkSource::LoadingRegion::LEVEL_LAZY && level < ChunkSource::LoadingRegion::LEVEL_LOAD ? 1 : 0;
+            }
+        }
+    }
+
+    i64 baseline_memory = getResidentMemory();
+    i64 peak_memory = baseline_memory;
+    u64 start = utils::getTimestampNanos();
+    u64 end = start + u64(settings.seconds * 1e9);
+    i64 ticks = 0;
+    std::vector<ChunkPosition> loaded_now;
+    while (utils::getTimestampNanos() < end) {
+        u64 tick_start = utils::getTimestampNanos();
+        math::Vec3i center = getRegionPosition(settings, f64(tick_start - start) / 1e9);
+        math::Vec3i region_position = region->getPosition();
+        if (center.x != region_position.x || center.y != region_position.y || center.z != region_position.z) {
+            region->setPosition(center);
+        }
+
+        loaded_now.clear();
+        for (i32 x = -settings.radius; x <= settings.radius; x++) {
+            for (i32 z = -settings.radius; z <= settings.radius; z++) {
+                for (i32 y = min_y; y <= max_y; y++) {
+                    ChunkPosition position(center.x + x, y, center.z + z);
+                    if (region->getLoadingLevelAt(position) < ChunkSource::LoadingRegion::LEVEL_LOAD) {
+                        continue;
+                    }
+                    i64 priority = settings.radius * 2 - std::max(std::abs(x), std::abs(z));
+                    first_fetch.try_emplace(position, tick_start);
+                    chunk_source->fetchChunkAt(position, priority, [&] (Chunk& chunk) {
+                        if (chunk.getState() == CHUNK_LOADED) {
+                            loaded_now.emplace_back(position);
+                        }
+                    });
+                }
+            }
+        }
+        for (auto& position : loaded_now) {
+            if (loaded_positions.emplace(position).second) {
+                fetch_to_loaded.record(i64(tick_start - first_fetch[position]));
+            }
+        }
+
+        chunk_source->onTick();
+        ticks++;
+        peak_memory = std::max(peak_memory, getResidentMemory());
+
+        u64 elapsed = utils::getTimestampNanos() - tick_start;
+        u64 interval = u64(settings.tick_interval) * 1000000;
+        if (elapsed < interval) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(interval - elapsed));
+        }
+    }
+    f64 seconds = f64(utils::getTimestampNanos() - start) / 1e9;
+
+    MetricsRegistry::Snapshot snapshot = chunk_source->getMetricsSnapshot();
+    ChunkSource::ChunkTaskStats task_stats = chunk_source->getChunkTaskStats();
+    std::printf("threads %d: %.1f s, %lld ticks, %zu chunks loaded at least once, %lld loaded now\n",
+                thread_count, seconds, (long long) ticks, loaded_positions.size(), (long long) snapshot.gauges["chunks_loaded"]);
+    std::printf("  stages:\n");
+    for (const char* stage : { "stage_build", "stage_process", "stage_load", "stage_store", "stage_unload", "provider_build_chunk" }) {
+        printHistogram(stage, snapshot.histograms[stage], seconds);
+    }
+    printHistogram("fetch_to_loaded", fetch_to_loaded.getSnapshot(), seconds);
+    std::printf("  tasks: queued %lld  executed %lld  stale %lld  cancelled %lld  wasted builds %.1f%%\n",
+                (long long) task_stats.queued_tasks, (long long) task_stats.executed_tasks,
+                (long long) task_stats.stale_tasks, (long long) task_stats.cancelled_tasks, task_stats.getWastedBuildRatio() * 100.0);
+    std::printf("  region: %s, vertical scale %.2f, %lld chunks within load level, %lld within lazy level\n",
+                settings.shape.c_str(), settings.vertical_scale, (long long) region_load_chunks, (long long) region_lazy_chunks);
+    std::printf("  memory: peak rss %.1f MiB (+%.1f MiB during run)\n",
+                f64(peak_memory) / 1048576.0, f64(peak_memory - baseline_memory) / 1048576.0);
+    ChunkSource::MemoryBudgetStats memory_stats = chunk_source->getMemoryBudgetStats();
+    std::printf("  chunk memory: %.1f MiB  peak %.1f MiB  budget %.1f MiB  evicted lazy %lld  loaded %lld  (%.1f MiB)\n",
+                f64(memory_stats.memory_usage) / 1048576.0, f64(memory_stats.peak_memory_usage) / 1048576.0,
+                f64(memory_stats.memory_budget) / 1048576.0, (long long) memory_stats.lazy_evictions,
+                (long long) memory_stats.loaded_evictions, f64(memory_stats.evicted_bytes) / 1048576.0);
+    if (terrain_provider != nullptr) {
+        TerrainChunkProvider::Stats terrain_stats = terrain_provider->getStats();
+        std::printf("  terrain: %.0f chunks/s per core  column cache hits %lld misses %lld\n",
+                    terrain_stats.getChunksPerSecondPerCore(), (long long) terrain_stats.column_cache_hits, (long long) terrain_stats.column_cache_misses);
+    }
+
+    runContention(*chunk_source, std::vector<ChunkPosition>(loaded_positions.begin(), loaded_positions.end()), settings.readers);
+    bool is_valid = structure_provider == nullptr || checkPendingEdits(*chunk_source, *structure_provider);
+
+    u64 shutdown_start = utils::getTimestampNanos();
+    chunk_source.reset();
+    std::printf("  shutdown: %.1f ms\n\n", f64(utils::getTimestampNanos() - shutdown_start) / 1e6);
+    return is_valid;
+}
+
+int main(int argc, char** argv) {
+    BenchmarkSettings settings;
+    if (!parseArguments(argc, argv, settings)) {
+        return 1;
+    }
+    std::printf("chunk pipeline benchmark: provider %s, pattern %s, radius %d, shape %s, %.1f s per run\n\n",
+                settings.provider.c_str(), settings.pattern.c_str(), settings.radius, settings.shape.c_str(), settings.seconds);
+    bool is_valid = true;
+    for (i32 thread_count : settings.thread_counts) {
+        is_valid = runBenchmark(settings, thread_count) && is_valid;
+    }
+    if (!is_valid) {
+        std::printf("some pending edits were lost without being reported\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,246 @@
+/*
+ * Offline world pre-generation. Creates any registered chunk provider by name, generates a box of chunks with
+ * ChunkSource on all cores, without window or GPU, and writes them into packed chunk storage. Chunks, that are
+ * already in the output storage, are skipped, so interrupted generation resumes, where it stopped.
+ *
+ * usage: world_pregen --output <dir> --min x,y,z --max x,y,z [--provider terrain] [--arg key=value ...]
+ *                     [--threads 0] [--in-flight 0] [--unload-timeout 50] [--flush-interval 10] [--list-providers]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <algorithm>
+#include <vector>
+#include <thread>
+
+#include "voxel/common/base.h"
+#include "voxel/common/utils/time.h"
+#include "voxel/engine/world/chunk.h"
+#include "voxel/engine/world/chunk_source.h"
+#include "voxel/engine/world/chunk_provider_registry.h"
+#include "voxel/engine/world/packed_chunk_storage.h"
+
+
+using namespace voxel;
+
+struct PregenSettings {
+    std::string output;
+    std::string provider = "terrain";
+    ChunkProviderRegistry::Arguments provider_arguments;
+    // inclusive box of chunk positions
+    ChunkPosition min = ChunkPosition(0, 0, 0);
+    ChunkPosition max = ChunkPosition(-1, -1, -1);
+    // 0 uses all cores
+    i32 threads = 0;
+    // max chunks, that are generated at once, 0 uses 64 per thread, 8 times more loaded chunks can wait to be stored
+    i32 in_flight = 0;
+    // loaded chunks are stored after about twice this time in milliseconds, providers, that require neighbours, need
+    // enough time for neighbours of each chunk to stay in memory, until it is processed
+    i32 unload_timeout = 50;
+    // interval in seconds to save storage index and print progress
+    f64 flush_interval = 10;
+    bool list_providers = false;
+};
+
+static bool parsePosition(const char* value, ChunkPosition& position) {
+    return std::sscanf(value, "%d,%d,%d", &position.x, &position.y, &position.z) == 3;
+}
+
+static bool parseArguments(i32 argc, char** argv, PregenSettings& settings) {
+    for (i32 i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--list-providers") {
+            settings.list_providers = true;
+            continue;
+        }
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (value == nullptr) {
+            std::fprintf(stderr, "missing value for %s\n", arg.c_str());
+            return false;
+        }
+        i++;
+        if (arg == "--output") {
+            settings.output = value;
+        } else if (arg == "--provider") {
+            settings.provider = value;
+        } else if (arg == "--arg") {
+            std::string pair = value;
+            size_t separator = pair.find('=');
+            if (separator == std::string::npos) {
+                std::fprintf(stderr, "provider argument must be key=value: %s\n", value);
+                return false;
+            }
+            settings.provider_arguments[pair.substr(0, separator)] = pair.substr(separator + 1);
+        } else if (arg == "--min" || arg == "--max") {
+            if (!parsePosition(value, arg == "--min" ? settings.min : settings.max)) {
+                std::fprintf(stderr, "chunk position must be x,y,z: %s\n", value);
+                return false;
+            }
+        } else if (arg == "--threads") {
+            settings.threads = std::atoi(value);
+        } else if (arg == "--in-flight") {
+            settings.in_flight = std::atoi(value);
+        } else if (arg == "--unload-timeout") {
+            settings.unload_timeout = std::atoi(value);
+        } else if (arg == "--flush-interval") {
+            settings.flush_interval = std::atof(value);
+        } else {
+            std::fprintf(stderr, "unknown argument %s\n", arg.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+static void printProgress(const char* prefix, PackedChunkStorage& storage, i64 total, i64 skipped, f64 seconds) {
+    PackedChunkStorage::Stats stats = storage.getStats();
+    i64 done = skipped + stats.stored_chunks;
+    f64 chunks_per_second = seconds > 0 ? f64(stats.stored_chunks) / seconds : 0;
+    f64 remaining_seconds = chunks_per_second > 0 ? f64(total - done) / chunks_per_second : 0;
+    std::printf("%s %lld / %lld chunks (%.1f%%)  %.0f chunks/s  %.0f bytes/chunk  %.1f MiB written  %.0f s remaining\n",
+                prefix, (long long) done, (long long) total, total > 0 ? 100.0 * f64(done) / f64(total) : 100.0, chunks_per_second,
+                stats.stored_chunks > 0 ? f64(stats.stored_bytes) / f64(stats.stored_chunks) : 0.0,
+                f64(stats.stored_bytes) / 1048576.0, remaining_seconds);
+    std::fflush(stdout);
+}
+
+int main(i32 argc, char** argv) {
+    PregenSettings settings;
+    if (!parseArguments(argc, argv, settings)) {
+        return 1;
+    }
+    if (settings.list_providers) {
+        for (auto& entry : ChunkProviderRegistry::get().getEntries()) {
+            std::printf("%s - %s\n", entry.name.c_str(), entry.description.c_str());
+        }
+        return 0;
+    }
+    if (settings.output.empty() || settings.min.x > settings.max.x || settings.min.y > settings.max.y || settings.min.z > settings.max.z) {
+        std::fprintf(stderr, "output directory and non-empty chunk box (--min, --max) are required\n");
+        return 1;
+    }
+
+    Unique<ChunkProvider> provider = ChunkProviderRegistry::get().createProvider(settings.provider, settings.provider_arguments);
+    if (!provider) {
+        std::fprintf(stderr, "unknown provider %s, use --list-providers\n", settings.provider.c_str());
+        return 1;
+    }
+    ChunkProvider* provider_ptr = provider.get();
+    auto storage = CreateUnique<PackedChunkStorage>(settings.output);
+    if (!storage->isOpen()) {
+        std::fprintf(stderr, "cannot open output storage in %s\n", settings.output.c_str());
+        return 1;
+    }
+    PackedChunkStorage* storage_ptr = storage.get();
+
+    // there are no loading regions, so chunks are kept only by fetches and unloaded through storage after them
+    i32 threads = settings.threads > 0 ? settings.threads : i32(std::max(1u, std::thread::hardware_concurrency()));
+    ChunkSource::Settings source_settings;
+    source_settings.worker_threads = threads;
+    source_settings.chunk_unload_timeout = settings.unload_timeout;
+    source_settings.loaded_chunk_updates = 1 << 16;
+    source_settings.chunk_update_resolution = 1;
+    Unique<ChunkSource> chunk_source = CreateUnique<ChunkSource>(std::move(provider), std::move(storage), source_settings);
+
+    // chunks are generated column by column, providers with column caches reuse them for all chunks of a column
+    std::vector<ChunkPosition> positions;
+    i64 total = 0, skipped = 0;
+    for (i32 x = settings.min.x; x <= settings.max.x; x++) {
+        for (i32 z = settings.min.z; z <= settings.max.z; z++) {
+            for (i32 y = settings.min.y; y <= settings.max.y; y++) {
+                ChunkPosition position(x, y, z);
+                if (!provider_ptr->canFetchChunk(*chunk_source, position)) {
+                    continue;
+                }
+                total++;
+                if (storage_ptr->containsChunk(position)) {
+                    skipped++;
+                } else {
+                    positions.emplace_back(position);
+                }
+            }
+        }
+    }
+    PackedChunkStorage::Stats initial_stats = storage_ptr->getStats();
+    std::printf("world pregen: provider %s, %lld chunks in box, %lld already stored (%lld recovered, %lld bytes truncated), %d threads\n",
+                settings.provider.c_str(), (long long) total, (long long) skipped,
+                (long long) initial_stats.recovered_chunks, (long long) initial_stats.truncated_bytes, threads);
+
+    // chunks are fetched, until they are loaded, then they wait for unloading, which stores them
+    i32 max_in_flight = settings.in_flight > 0 ? settings.in_flight : threads * 64;
+    i32 max_storing = max_in_flight * 8;
+    std::vector<ChunkSource::ChunkFetch> fetching;
+    std::vector<ChunkPosition> storing;
+    std::vector<ChunkSource::ChunkFetch> still_fetching;
+    std::vector<bool> is_loaded;
+    size_t next_position = 0;
+    u64 start = utils::getTimestampNanos();
+    u64 last_flush = start;
+    i64 priority = i64(positions.size());
+    while (next_position < positions.size() || !fetching.empty() || !storing.empty()) {
+        while (next_position < positions.size() && i32(fetching.size()) < max_in_flight && i32(storing.size()) < max_storing) {
+            // earlier chunks have higher priority, so chunks are completed in order
+            fetching.push_back({ positions[next_position++], priority-- });
+        }
+
+        is_loaded.assign(fetching.size(), false);
+        chunk_source->fetchChunksAt(fetching, [&] (Chunk& chunk, i32 index) {
+            is_loaded[index] = chunk.getState() == CHUNK_LOADED;
+        });
+        still_fetching.clear();
+        for (size_t i = 0; i < fetching.size(); i++) {
+            if (is_loaded[i]) {
+                storing.emplace_back(fetching[i].position);
+            } else {
+                still_fetching.emplace_back(fetching[i]);
+            }
+        }
+        fetching.swap(still_fetching);
+        storing.erase(std::remove_if(storing.begin(), storing.end(), [&] (ChunkPosition position) {
+            return storage_ptr->containsChunk(position);
+        }), storing.end());
+
+        chunk_source->onTick();
+
+        u64 now = utils::getTimestampNanos();
+        if (f64(now - last_flush) / 1e9 >= settings.flush_interval) {
+            last_flush = now;
+            storage_ptr->flush();
+            printProgress("progress:", *storage_ptr, total, skipped, f64(now - start) / 1e9);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    // edits, that target chunks, stored before the edits were emitted, are written into storage, until they stop
+    // decreasing, edits of chunks outside of the box, that are not stored, are dropped and reported by chunk source
+    i64 pending_edits = chunk_source->getMetricsSnapshot().gauges["pending_edits"];
+    u64 last_progress = utils::getTimestampNanos();
+    while (pending_edits > 0 && f64(utils::getTimestampNanos() - last_progress) / 1e9 < 5.0) {
+        chunk_source->storePendingEdits();
+        for (i32 i = 0; i < 100; i++) {
+            chunk_source->onTick();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        i64 remaining_edits = chunk_source->getMetricsSnapshot().gauges["pending_edits"];
+        if (remaining_edits < pending_edits) {
+            last_progress = utils::getTimestampNanos();
+        }
+        pending_edits = remaining_edits;
+    }
+
+    f64 seconds = f64(utils::getTimestampNanos() - start) / 1e9;
+    storage_ptr->flush();
+    printProgress("done:", *storage_ptr, total, skipped, seconds);
+
+    MetricsRegistry::Snapshot snapshot = chunk_source->getMetricsSnapshot();
+    i64 dropped_edits = snapshot.counters["pending_edits_dropped"] + snapshot.counters["pending_edits_expired"];
+    if (dropped_edits > 0 || snapshot.gauges["pending_edits"] > 0) {
+        std::printf("warning: %lld pending edits were dropped and %lld are still pending, they target chunks outside of the box, "
+                    "that are not stored\n", (long long) dropped_edits, (long long) snapshot.gauges["pending_edits"]);
+    }
+    PackedChunkStorage::Stats stats = storage_ptr->getStats();
+    std::printf("output: %lld chunks, %.1f MiB in %s\n", (long long) stats.chunk_count, f64(stats.data_size) / 1048576.0, settings.output.c_str());
+    chunk_source.reset();
+    return 0;
+}